@@ -0,0 +1,83 @@
+#ifndef AUTOTUNER_HPP
+#define AUTOTUNER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caf/opencl/nd_range.hpp"
+
+#include "include/util.hpp"
+
+/// Launch configuration of a kernel.
+struct launch_config {
+  std::string kernel;
+  std::vector<size_t> global;
+  std::vector<size_t> local; // empty leaves the choice to the driver
+  double runtime_us = 0;     // kernel time measured by the tuner
+};
+
+/// Kernel that solves the tuned problem. Variants of a kernel that compute
+/// several outputs per work-item (coarsening) are separate candidates.
+struct tuning_candidate {
+  std::string kernel;
+  std::vector<size_t> global;
+  std::vector<size_t> fixed_local; // non-empty if the kernel requires it
+};
+
+/// Buffer passed to the kernel while tuning, in argument order.
+struct tuning_arg {
+  size_t bytes;
+  const void* data; // initial content or nullptr
+};
+
+/// Identifies a device in the cache, i.e., its name and driver version.
+std::string device_identity(cl_device_id device);
+
+/// Winning configurations stored in a text file with one tab separated line
+/// per device and problem. Later lines override earlier ones.
+class tuning_cache {
+public:
+  explicit tuning_cache(std::string path);
+
+  bool find(cl_device_id device, const std::string& problem,
+            launch_config& config) const;
+
+  void store(cl_device_id device, const std::string& problem,
+             const launch_config& config);
+
+private:
+  std::string path_;
+  std::map<std::string, launch_config> entries_;
+};
+
+/// Sweeps all local sizes that are valid for `device` (powers of two per
+/// dimension that divide the global size) for each candidate and returns
+/// the fastest configuration. Runs every configuration `repetitions` times
+/// on a private context and keeps the minimum kernel time.
+launch_config autotune(cl_device_id device, const char* source,
+                       const std::vector<tuning_candidate>& candidates,
+                       const std::vector<tuning_arg>& args,
+                       size_t repetitions = 3);
+
+/// Returns the cached configuration of `problem` for `device`. On a miss,
+/// runs `autotune` and stores the result if `tune` is set, otherwise
+/// returns false.
+bool tuned_config(tuning_cache& cache, bool tune, cl_device_id device,
+                  const std::string& problem, const char* source,
+                  const std::vector<tuning_candidate>& candidates,
+                  const std::vector<tuning_arg>& args,
+                  launch_config& config);
+
+/// Converts `config` to the launch dimensions of an OpenCL actor.
+inline caf::opencl::nd_range to_nd_range(const launch_config& config) {
+  caf::opencl::dim_vec global;
+  caf::opencl::dim_vec local;
+  for (auto x : config.global)
+    global.push_back(x);
+  for (auto x : config.local)
+    local.push_back(x);
+  return caf::opencl::nd_range{global, {}, local};
+}
+
+#endif // AUTOTUNER_HPP
@@ -0,0 +1,56 @@
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include <utility>
+
+#include "include/util.hpp"
+
+/// Recycles device buffers of a single context. Buffers are allocated in
+/// power-of-two size classes and kept per class and memory flags when
+/// released, so a later request of the same class skips `clCreateBuffer`.
+/// A disabled pool allocates exactly the requested size and frees buffers
+/// on release, but still maintains the counters.
+class buffer_pool {
+public:
+  struct statistics {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t bytes_outstanding = 0;      // acquired and not yet released
+    size_t peak_bytes_outstanding = 0;
+    size_t bytes_pooled = 0;           // released and kept for reuse
+  };
+
+  explicit buffer_pool(context_ptr context, bool enabled = true);
+
+  buffer_pool(const buffer_pool&) = delete;
+  buffer_pool& operator=(const buffer_pool&) = delete;
+
+  /// Returns a buffer with at least `bytes` bytes.
+  mem_ptr acquire(cl_mem_flags flags, size_t bytes);
+
+  /// Hands `buf` back to the pool. Must be called once per acquired buffer.
+  void release(mem_ptr buf);
+
+  /// Frees all pooled buffers.
+  void clear();
+
+  statistics stats() const;
+
+  inline bool enabled() const {
+    return enabled_;
+  }
+
+private:
+  using key = std::pair<cl_mem_flags, size_t>;
+
+  context_ptr context_;
+  bool enabled_;
+  mutable std::mutex mtx_;
+  std::map<key, std::vector<mem_ptr>> free_;
+  statistics stats_;
+};
+
+#endif // BUFFER_POOL_HPP
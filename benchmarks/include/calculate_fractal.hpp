@@ -9,6 +9,7 @@
 #include <QImage>
 
 #include "config.hpp"
+#include "mandelbrot.hpp"
 
 #include "caf/all.hpp"
 
@@ -32,27 +33,9 @@ caf::behavior mandel() {
         float_type min_re, float_type max_re,
         float_type min_im, float_type max_im) {
       std::vector<int> image(width * height);
-      auto re_factor = (max_re - min_re) / (width - 1);
-      auto im_factor = (max_im - min_im) / (height - 1);
-      for (uint32_t y = 0; y < height; ++y) {
-        for (uint32_t x = 0; x < width; ++x) {
-          auto z_re = min_re + x * re_factor;
-          auto z_im = max_im - y * im_factor;
-          auto const_re = z_re;
-          auto const_im = z_im;
-          uint32_t cnt = 0;
-          float_type cond = 0;
-          do {
-            auto tmp_re = z_re;
-            auto tmp_im = z_im;
-            z_re = (tmp_re * tmp_re - tmp_im * tmp_im) + const_re;
-            z_im = (2 * tmp_re * tmp_im) + const_im;
-            cond = z_re * z_re + z_im * z_im;
-            ++cnt;
-          } while (cnt < iterations && cond <= 4.0f);
-          image[x+y*width] = cnt;
-        }
-      }
+      mandelbrot_view view{iterations, width, height,
+                           min_re, max_re, min_im, max_im};
+      mandelbrot_rows(view, 0, height, image.data());
       return image;
     }
   };
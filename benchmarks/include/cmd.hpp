@@ -1,46 +1,166 @@
 #ifndef CMD_HPP
 #define CMD_HPP
 
+#include <new>
 #include <mutex>
+#include <atomic>
 #include <vector>
 #include <string>
 #include <future>
+#include <cstdlib>
 #include <condition_variable>
 
 #include "include/util.hpp"
+#include "include/buffer_pool.hpp"
 
+/// How `cmd` moves matrices between host and device.
+enum class transfer_mode {
+  pageable,  // read and write from ordinary host memory (baseline)
+  pinned,    // stage through mapped CL_MEM_ALLOC_HOST_PTR buffers
+  zero_copy  // let the kernel access page-aligned host memory directly
+};
+
+bool parse_transfer_mode(const std::string& str, transfer_mode& mode);
+
+std::string to_string(transfer_mode mode);
+
+/// Allocates page-aligned memory, a requirement for zero-copy buffers on
+/// most runtimes.
+template <class T>
+struct page_allocator {
+  using value_type = T;
+
+  static constexpr size_t page_size = 4096;
+
+  page_allocator() = default;
+
+  template <class U>
+  page_allocator(const page_allocator<U>&) {
+    // nop
+  }
+
+  T* allocate(size_t n) {
+    void* ptr = nullptr;
+    auto bytes = (n * sizeof(T) + page_size - 1) / page_size * page_size;
+    if (posix_memalign(&ptr, page_size, bytes) != 0)
+      throw std::bad_alloc();
+    return static_cast<T*>(ptr);
+  }
+
+  void deallocate(T* ptr, size_t) {
+    free(ptr);
+  }
+};
+
+template <class T, class U>
+bool operator==(const page_allocator<T>&, const page_allocator<U>&) {
+  return true;
+}
+
+template <class T, class U>
+bool operator!=(const page_allocator<T>&, const page_allocator<U>&) {
+  return false;
+}
+
+using host_matrix = std::vector<float, page_allocator<float>>;
+
+/// Device timestamps of a command in nanoseconds, all zero for commands
+/// that a transfer mode skips.
+struct command_times {
+  cl_ulong queued;
+  cl_ulong submit;
+  cl_ulong start;
+  cl_ulong end;
+};
+
+/// Timestamps of all commands of one iteration.
+struct iteration_profile {
+  command_times upload[2];
+  command_times kernel;
+  command_times download;
+};
+
+/// Runs `iterations` matrix multiplications, each uploading the input,
+/// running the kernel and reading the result. Every queue keeps one
+/// iteration in flight, i.e., the number of queues is the pipeline depth.
+/// With a single queue, the result is read back blocking as in the
+/// original baseline.
 class cmd {
 public:
   cmd(size_t size, kernel_ptr kernel, context_ptr context,
-      command_queue_ptr queue, size_t iterations);
+      std::vector<command_queue_ptr> queues, size_t iterations,
+      std::vector<size_t> global_dimensions,
+      std::vector<size_t> local_dimensions, buffer_pool& pool,
+      transfer_mode mode = transfer_mode::pageable);
   ~cmd();
   void enqueue();
   void wait();
 
+  /// Collects the timestamps of every iteration, requires queues created
+  /// with `CL_QUEUE_PROFILING_ENABLE`. Must be called before `enqueue`.
+  inline void enable_profiling() {
+    profiling_ = true;
+  }
+
+  /// Profiles of all completed iterations in completion order.
+  std::vector<iteration_profile> profile();
+
 private:
+  struct slot {
+    cmd* parent;
+    command_queue_ptr queue;
+    mem_ptr buf_in_1;
+    mem_ptr buf_in_2;
+    mem_ptr buf_out;
+    cl_event write_events[2];
+    cl_event kernel_event;
+    cl_event read_event;
+    cl_event marker;
+    host_matrix result;
+    // pinned: staging buffers for both inputs and the result, mapped once
+    mem_ptr staging[3];
+    float* staged[3];
+    // zero-copy: result buffer backed by `result`, mapped after each kernel
+    mem_ptr host_out;
+    void* mapped_out;
+  };
+
   size_t size_;
   std::mutex mtx_;
   std::condition_variable cv_;
-  cl_mem buf_in_1_;
-  cl_mem buf_in_2_;
-  cl_mem buf_out_;
-  cl_event write_events_[2];
-  cl_event kernel_event_;
-  cl_event read_event_;
-  cl_event marker_;
+  bool done_;
+  std::mutex kernel_mtx_; // guards arguments of the shared kernel
   kernel_ptr kernel_;
   context_ptr context_;
-  command_queue_ptr queue_;
+  buffer_pool& pool_;
+  transfer_mode mode_;
+  mem_ptr host_in_1_; // zero-copy input buffers, shared by all slots
+  mem_ptr host_in_2_;
+  std::vector<slot> slots_;
+  bool refill_;
 
   size_t max_iterations_;
-  size_t current_iterations_;
+  std::atomic<size_t> next_iteration_;
+  std::atomic<size_t> current_iterations_;
 
-  std::vector<float> matrix_1_;
-  std::vector<float> matrix_2_;
-  std::vector<float> result_;
+  host_matrix matrix_1_;
+  host_matrix matrix_2_;
   std::vector<size_t> dimensions_;
+  std::vector<size_t> local_dimensions_;
+
+  bool profiling_;
+  std::mutex profile_mtx_;
+  std::vector<iteration_profile> profile_;
+
+  void fill_input();
+
+  void prepare(slot& s);
+
+  void enqueue(slot& s);
+
+  void release_events(slot& s);
 
-  void make_decision();
+  void make_decision(slot& s);
 };
 
 #endif //CMD_HPP
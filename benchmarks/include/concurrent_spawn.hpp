@@ -0,0 +1,98 @@
+#ifndef CONCURRENT_SPAWN_HPP
+#define CONCURRENT_SPAWN_HPP
+
+#include <chrono>
+#include <vector>
+#include <cstddef>
+#include <iostream>
+#include <functional>
+
+#include "caf/all.hpp"
+
+#include "include/statistics.hpp"
+#include "include/memory_usage.hpp"
+
+/// Measurements of `concurrent_spawn`.
+struct spawn_report {
+  size_t spawners = 0;
+  size_t actors = 0;
+  double runtime_us = 0;
+  double actors_per_second = 0;
+  summary latency; // per spawn in microseconds
+  size_t peak_rss = 0;
+};
+
+/// Spawns `count` actors with `spawn` from `spawners` concurrent spawner
+/// actors, i.e., from up to `spawners` scheduler threads at once. All
+/// actors stay alive until every spawner has finished. `spawn` must be
+/// safe to call from several threads.
+inline spawn_report concurrent_spawn(caf::actor_system& system,
+                                     size_t spawners, size_t count,
+                                     std::function<caf::actor ()> spawn) {
+  using namespace caf;
+  using clock = std::chrono::high_resolution_clock;
+  using spawned_atom = atom_constant<atom("spawned")>;
+  spawners = std::max(spawners, size_t{1});
+  std::vector<std::vector<actor>> alive(spawners);
+  std::vector<std::vector<double>> latencies(spawners);
+  spawn_report result;
+  {
+    scoped_actor self{system};
+    auto coordinator = actor_cast<actor>(self);
+    auto start = clock::now();
+    for (size_t t = 0; t < spawners; ++t) {
+      auto n = count / spawners + (t < count % spawners ? 1 : 0);
+      auto& handles = alive[t];
+      auto& samples = latencies[t];
+      system.spawn([=, &handles, &samples](event_based_actor* spawner) {
+        handles.reserve(n);
+        samples.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+          auto before = clock::now();
+          handles.push_back(spawn());
+          auto after = clock::now();
+          samples.push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+              after - before
+            ).count() / 1000.0
+          );
+        }
+        spawner->send(coordinator, spawned_atom::value);
+      });
+    }
+    for (size_t t = 0; t < spawners; ++t)
+      self->receive([](spawned_atom) {
+        // nop
+      });
+    auto runtime = std::chrono::duration_cast<std::chrono::microseconds>(
+      clock::now() - start
+    );
+    result.runtime_us = runtime.count();
+  }
+  std::vector<double> all;
+  all.reserve(count);
+  for (auto& samples : latencies)
+    all.insert(all.end(), samples.begin(), samples.end());
+  result.spawners = spawners;
+  result.actors = count;
+  result.actors_per_second = result.runtime_us > 0
+                             ? count * 1e6 / result.runtime_us
+                             : 0.0;
+  result.latency = summarize(std::move(all));
+  result.peak_rss = peak_resident_bytes();
+  return result;
+}
+
+/// Prints `report` as one CSV line to stdout: spawners, scheduler threads,
+/// actors, runtime in us, actors/s, mean, p50 and p99 latency in us and
+/// peak RSS in bytes.
+inline void print_spawn_report(const spawn_report& report,
+                               size_t scheduler_threads) {
+  std::cout << report.spawners << ", " << scheduler_threads << ", "
+            << report.actors << ", " << report.runtime_us << ", "
+            << report.actors_per_second << ", " << report.latency.mean << ", "
+            << report.latency.p50 << ", " << report.latency.p99 << ", "
+            << report.peak_rss << std::endl;
+}
+
+#endif // CONCURRENT_SPAWN_HPP
@@ -0,0 +1,50 @@
+#ifndef COUNT_FORMAT_HPP
+#define COUNT_FORMAT_HPP
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+/// Encoding of the iteration counts an OpenCL kernel writes per pixel.
+enum class count_format {
+  /// the plain count
+  int32,
+  /// the count, clamped to 65535
+  uint16,
+  /// bit 7 is set for escaped points, whose count is stored in the lower
+  /// seven bits clamped to 127, other points have the maximum count
+  uint8
+};
+
+/// Parses "int32", "uint16" or "uint8", returns false for anything else.
+bool parse_count_format(const std::string& name, count_format& format);
+
+const char* to_string(count_format format);
+
+/// Bytes per pixel.
+size_t count_bytes(count_format format);
+
+/// Returns whether decoding restores all counts of a render with at most
+/// `iterations` iterations.
+bool exact_counts(count_format format, uint32_t iterations);
+
+/// Build options that select `format` in the OpenCL program.
+const char* count_format_options(count_format format);
+
+/// Encodes `n` counts like the OpenCL kernels do.
+void encode_counts(const int* in, size_t n, uint32_t iterations,
+                   uint16_t* out);
+
+void encode_counts(const int* in, size_t n, uint32_t iterations,
+                   uint8_t* out);
+
+/// Decodes `n` counts of a render with `iterations` iterations.
+void decode_counts(const int* in, size_t n, uint32_t iterations, int* out);
+
+void decode_counts(const uint16_t* in, size_t n, uint32_t iterations,
+                   int* out);
+
+void decode_counts(const uint8_t* in, size_t n, uint32_t iterations,
+                   int* out);
+
+#endif // COUNT_FORMAT_HPP
@@ -0,0 +1,67 @@
+#ifndef GEMM_HPP
+#define GEMM_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+/// Inner kernels for the CPU matrix multiplication.
+enum class gemm_kernel {
+  naive,   ///< one dot product per cell, strided walk over the rhs
+  blocked, ///< packed rhs, cache and register tiling, scalar code
+  simd     ///< same tiling as blocked with AVX2 or AVX-512 micro kernels
+};
+
+/// Accepts `naive`, `blocked` and `simd`, returns false otherwise.
+bool parse_gemm_kernel(const std::string& name, gemm_kernel& kernel);
+
+const char* to_string(gemm_kernel kernel);
+
+/// Name of the instruction set selected at runtime for `gemm_kernel::simd`.
+const char* simd_isa();
+
+/// Multiplies two square matrices stored in row-major order. The constructor
+/// packs the right-hand side into column panels once, afterwards `compute`
+/// may be called concurrently for disjoint parts of the result.
+class gemm_engine {
+public:
+  /// Number of result rows computed per micro kernel invocation.
+  static constexpr size_t block_rows = 4;
+  /// Width of a packed column panel of the rhs.
+  static constexpr size_t block_cols = 16;
+  /// Depth of the rhs slices that are kept in L1 (16 KB per panel).
+  static constexpr size_t block_depth = 256;
+  /// Rows of the lhs that are kept in L2 for one rhs slice.
+  static constexpr size_t block_height = 64;
+
+  gemm_engine(gemm_kernel kernel, const std::vector<float>& lhs,
+              const std::vector<float>& rhs, size_t size);
+
+  /// Computes all cells in [row_first, row_last) x [col_first, col_last)
+  /// of `result`, which has `size() * size()` elements.
+  void compute(float* result, size_t row_first, size_t row_last,
+               size_t col_first, size_t col_last) const;
+
+  inline size_t size() const {
+    return size_;
+  }
+
+  inline gemm_kernel kernel() const {
+    return kernel_;
+  }
+
+private:
+  void compute_naive(float* result, size_t row_first, size_t row_last,
+                     size_t col_first, size_t col_last) const;
+
+  void compute_packed(float* result, size_t row_first, size_t row_last,
+                      size_t col_first, size_t col_last) const;
+
+  gemm_kernel kernel_;
+  const float* lhs_;
+  const float* rhs_;
+  size_t size_;
+  std::vector<float> packed_;
+};
+
+#endif // GEMM_HPP
@@ -0,0 +1,76 @@
+#ifndef IMAGE_SINK_HPP
+#define IMAGE_SINK_HPP
+
+#include <atomic>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+/// On-disk layout of an `image_sink`.
+enum class image_format {
+  /// binary PGM with 8 or 16 bit samples, depending on the maximum count
+  pgm,
+  /// headerless 32 bit counts in host byte order
+  raw
+};
+
+/// Parses "pgm" or "raw", returns false for anything else.
+bool parse_image_format(const std::string& name, image_format& format);
+
+const char* to_string(image_format format);
+
+/// Iteration counts written row by row into a memory-mapped file. Pages are
+/// dropped from the process after each write, hence the resident memory of a
+/// render is bounded by the rows in flight rather than by the image and the
+/// image may exceed the main memory. Writes of disjoint rows may run
+/// concurrently. Throws `std::runtime_error` if the file cannot be mapped.
+class image_sink {
+public:
+  image_sink(const std::string& path, image_format format, uint32_t width,
+             uint32_t height, uint32_t max_count);
+
+  ~image_sink();
+
+  image_sink(const image_sink&) = delete;
+  image_sink& operator=(const image_sink&) = delete;
+
+  /// Stores `rows` rows starting at row `first`, `counts` holds them without
+  /// padding. Counts above the maximum of the format are clamped.
+  void write_rows(uint32_t first, uint32_t rows, const int* counts);
+
+  /// Writes all rows to disk and returns the time this took in ns.
+  uint64_t flush();
+
+  /// Size of the file in bytes.
+  inline size_t file_bytes() const {
+    return size_;
+  }
+
+  /// Sample bytes stored so far.
+  inline uint64_t bytes_written() const {
+    return bytes_;
+  }
+
+  /// Time spent in `write_rows` so far, summed over all threads.
+  inline uint64_t write_ns() const {
+    return write_ns_;
+  }
+
+  inline image_format format() const {
+    return format_;
+  }
+
+private:
+  image_format format_;
+  uint32_t width_;
+  uint32_t max_count_;
+  size_t sample_bytes_;
+  size_t header_bytes_;
+  size_t size_;
+  int fd_;
+  unsigned char* data_;
+  std::atomic<uint64_t> bytes_;
+  std::atomic<uint64_t> write_ns_;
+};
+
+#endif // IMAGE_SINK_HPP
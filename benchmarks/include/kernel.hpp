@@ -1,6 +1,10 @@
 #ifndef KERNEL_HPP
 #define KERNEL_HPP
 
+#include <string>
+#include <vector>
+#include <cstddef>
+
 namespace {
 constexpr const char* kernel_name  = "matrix_mult";
 constexpr const char* kernel_name2 = "l_dim_1";
@@ -11,7 +15,49 @@ constexpr const char* kernel_name6 = "cpy";
 constexpr const char* kernel_name7 = "cpy_more";
 constexpr const char* kernel_name8 = "cpy_3d";
 
+/// Variant of the float matrix multiplication in `kernel_source`.
+struct matrix_kernel {
+  const char* name;
+  size_t local;   // edge length of a work-group, 0 leaves it to the driver
+  size_t block_x; // output columns per work-item
+  size_t block_y; // output rows per work-item
+};
+
+constexpr matrix_kernel matrix_kernels[] = {
+  {"matrix_mult",       0,  1, 1}, // naive, everything from global memory
+  {"matrix_mult_tiled", 16, 1, 1}, // 16x16 tiles staged in local memory
+  {"matrix_mult_reg2",  0,  2, 2}, // 2x2 outputs per work-item
+  {"matrix_mult_reg4",  0,  4, 4}, // 4x4 outputs per work-item, float4 loads
+  {"matrix_mult_vec4",  0,  4, 1}  // 1x4 outputs per work-item, float4 loads
+};
+
+/// Returns the variant called `name` or `nullptr`.
+inline const matrix_kernel* find_matrix_kernel(const std::string& name) {
+  for (auto& k : matrix_kernels)
+    if (name == k.name)
+      return &k;
+  return nullptr;
+}
+
+/// Computes global and local dimensions of `k` for a `size` x `size` matrix.
+/// Returns false if `size` is not a multiple of the blocking of `k`.
+inline bool matrix_kernel_dims(const matrix_kernel& k, size_t size,
+                               std::vector<size_t>& global,
+                               std::vector<size_t>& local) {
+  auto group = k.local > 0 ? k.local : 1;
+  if (size % (k.block_x * group) != 0 || size % (k.block_y * group) != 0)
+    return false;
+  global = {size / k.block_x, size / k.block_y};
+  if (k.local > 0)
+    local = {k.local, k.local};
+  else
+    local.clear();
+  return true;
+}
+
 constexpr const char* kernel_source = R"__(
+    #define TILE_SIZE 16
+
     __kernel void matrix_mult(__global float* matrix1,
                               __global float* matrix2,
                               __global float* output) {
@@ -25,6 +71,90 @@ constexpr const char* kernel_source = R"__(
         output[x+y*size] = result;
     }
 
+    // requires a local size of TILE_SIZE x TILE_SIZE
+    __kernel void matrix_mult_tiled(__global float* matrix1,
+                                    __global float* matrix2,
+                                    __global float* output) {
+        __local float tile1[TILE_SIZE][TILE_SIZE];
+        __local float tile2[TILE_SIZE][TILE_SIZE];
+        size_t size = get_global_size(0); // == get_global_size_(1);
+        size_t x = get_global_id(0);
+        size_t y = get_global_id(1);
+        size_t lx = get_local_id(0);
+        size_t ly = get_local_id(1);
+        float result = 0;
+        for (size_t offset = 0; offset < size; offset += TILE_SIZE) {
+            tile1[ly][lx] = matrix1[(offset + lx) + y * size];
+            tile2[ly][lx] = matrix2[x + (offset + ly) * size];
+            barrier(CLK_LOCAL_MEM_FENCE);
+            for (size_t idx = 0; idx < TILE_SIZE; ++idx) {
+                result += tile1[ly][idx] * tile2[idx][lx];
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+        }
+        output[x+y*size] = result;
+    }
+
+    __kernel void matrix_mult_reg2(__global float* matrix1,
+                                   __global float* matrix2,
+                                   __global float* output) {
+        size_t size = get_global_size(0) * 2;
+        size_t x = get_global_id(0) * 2;
+        size_t y = get_global_id(1) * 2;
+        float c00 = 0, c01 = 0, c10 = 0, c11 = 0;
+        for (size_t idx = 0; idx < size; ++idx) {
+            float a0 = matrix1[idx + y * size];
+            float a1 = matrix1[idx + (y + 1) * size];
+            float b0 = matrix2[x + idx * size];
+            float b1 = matrix2[x + 1 + idx * size];
+            c00 += a0 * b0;
+            c01 += a0 * b1;
+            c10 += a1 * b0;
+            c11 += a1 * b1;
+        }
+        output[x + y * size] = c00;
+        output[x + 1 + y * size] = c01;
+        output[x + (y + 1) * size] = c10;
+        output[x + 1 + (y + 1) * size] = c11;
+    }
+
+    __kernel void matrix_mult_reg4(__global float* matrix1,
+                                   __global float* matrix2,
+                                   __global float* output) {
+        size_t size = get_global_size(0) * 4;
+        size_t x = get_global_id(0) * 4;
+        size_t y = get_global_id(1) * 4;
+        float4 c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+        for (size_t idx = 0; idx < size; ++idx) {
+            float4 b = vload4(0, matrix2 + x + idx * size);
+            c0 += matrix1[idx + y * size] * b;
+            c1 += matrix1[idx + (y + 1) * size] * b;
+            c2 += matrix1[idx + (y + 2) * size] * b;
+            c3 += matrix1[idx + (y + 3) * size] * b;
+        }
+        vstore4(c0, 0, output + x + y * size);
+        vstore4(c1, 0, output + x + (y + 1) * size);
+        vstore4(c2, 0, output + x + (y + 2) * size);
+        vstore4(c3, 0, output + x + (y + 3) * size);
+    }
+
+    __kernel void matrix_mult_vec4(__global float* matrix1,
+                                   __global float* matrix2,
+                                   __global float* output) {
+        size_t size = get_global_size(0) * 4;
+        size_t x = get_global_id(0) * 4;
+        size_t y = get_global_id(1);
+        float4 result = 0;
+        for (size_t idx = 0; idx < size; idx += 4) {
+            float4 a = vload4(0, matrix1 + idx + y * size);
+            result += a.x * vload4(0, matrix2 + x + idx * size);
+            result += a.y * vload4(0, matrix2 + x + (idx + 1) * size);
+            result += a.z * vload4(0, matrix2 + x + (idx + 2) * size);
+            result += a.w * vload4(0, matrix2 + x + (idx + 3) * size);
+        }
+        vstore4(result, 0, output + x + y * size);
+    }
+
     __kernel void matrix_mult_int(__global int* matrix1,
                                   __global int* matrix2,
                                   __global int* output) {
@@ -0,0 +1,85 @@
+#ifndef KERNEL_POOL_HPP
+#define KERNEL_POOL_HPP
+
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <functional>
+
+#include "caf/all.hpp"
+
+/// Bounded set of OpenCL actors for one program, kernel and signature,
+/// shared by many `pooled_facade` actors. Each pooled actor owns a kernel
+/// object and its argument state. They are spawned on first use.
+class kernel_pool {
+public:
+  using factory = std::function<caf::actor ()>;
+
+  kernel_pool(factory f, size_t size)
+    : factory_(std::move(f)),
+      workers_(size > 0 ? size : 1),
+      next_(0) {
+    // nop
+  }
+
+  /// Returns the next worker in round-robin order.
+  caf::actor get() {
+    std::lock_guard<std::mutex> guard{mtx_};
+    auto& worker = workers_[next_++ % workers_.size()];
+    if (!worker)
+      worker = factory_();
+    return worker;
+  }
+
+  /// Number of workers spawned so far.
+  size_t spawned() {
+    std::lock_guard<std::mutex> guard{mtx_};
+    size_t result = 0;
+    for (auto& worker : workers_)
+      if (worker)
+        ++result;
+    return result;
+  }
+
+private:
+  std::mutex mtx_;
+  factory factory_;
+  std::vector<caf::actor> workers_;
+  size_t next_;
+};
+
+using kernel_pool_ptr = std::shared_ptr<kernel_pool>;
+
+/// Logical OpenCL actor that holds no kernel state itself. Binds to a
+/// worker of the pool when it receives its first message and delegates
+/// all messages of type `Ts...` to it, i.e., the worker replies to the
+/// original sender.
+template <class... Ts>
+class pooled_facade : public caf::event_based_actor {
+public:
+  pooled_facade(caf::actor_config& cfg, kernel_pool_ptr pool)
+    : caf::event_based_actor(cfg),
+      pool_(std::move(pool)) {
+    // nop
+  }
+
+  caf::behavior make_behavior() override {
+    return {
+      [=](Ts&... xs) {
+        return delegate(worker(), std::move(xs)...);
+      }
+    };
+  }
+
+private:
+  const caf::actor& worker() {
+    if (!worker_)
+      worker_ = pool_->get();
+    return worker_;
+  }
+
+  kernel_pool_ptr pool_;
+  caf::actor worker_;
+};
+
+#endif // KERNEL_POOL_HPP
@@ -0,0 +1,54 @@
+#ifndef LOAD_BALANCER_HPP
+#define LOAD_BALANCER_HPP
+
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "caf/all.hpp"
+
+/// Strategy of a `load_balancer` for choosing the worker of the next job.
+enum class balance_policy {
+  round_robin,        // cycle through all workers
+  least_outstanding,  // fewest jobs in flight
+  throughput_weighted // shortest expected completion time, i.e., jobs in
+                      // flight times the measured time per job
+};
+
+bool parse_balance_policy(const std::string& str, balance_policy& policy);
+
+std::string to_string(balance_policy policy);
+
+/// Front actor for several OpenCL actors that compute the same kernel,
+/// e.g., one per device. Relays each matrix job to a worker chosen by the
+/// policy and the result back to the sender. Prints the number of jobs
+/// and the mean round trip per worker to stderr when it terminates.
+class load_balancer : public caf::event_based_actor {
+public:
+  load_balancer(caf::actor_config& cfg, std::vector<caf::actor> workers,
+                std::vector<std::string> labels, balance_policy policy);
+
+  caf::behavior make_behavior() override;
+
+  void on_exit() override;
+
+private:
+  using clock = std::chrono::high_resolution_clock;
+
+  struct worker_state {
+    caf::actor handle;
+    std::string label;
+    size_t outstanding = 0;
+    size_t completed = 0;
+    double total_us = 0;
+    double avg_us = 0; // moving average of the round trip
+  };
+
+  size_t pick();
+
+  std::vector<worker_state> workers_;
+  balance_policy policy_;
+  size_t next_;
+};
+
+#endif // LOAD_BALANCER_HPP
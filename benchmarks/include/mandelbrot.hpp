@@ -0,0 +1,73 @@
+#ifndef MANDELBROT_HPP
+#define MANDELBROT_HPP
+
+#include <string>
+#include <cstdint>
+
+#include "include/config.hpp"
+
+/// Inner kernels for rendering on the CPU.
+enum class mandelbrot_kernel {
+  scalar, ///< one pixel at a time
+  simd    ///< 8 or 16 pixels per step with AVX2 or AVX-512, scalar otherwise
+};
+
+/// Accepts `scalar` and `simd`, returns false otherwise.
+bool parse_mandelbrot_kernel(const std::string& name,
+                             mandelbrot_kernel& kernel);
+
+const char* to_string(mandelbrot_kernel kernel);
+
+/// Name of the instruction set selected at runtime for
+/// `mandelbrot_kernel::simd`.
+const char* mandelbrot_isa();
+
+/// Section of the complex plane rendered into a `width` x `height` image.
+struct mandelbrot_view {
+  uint32_t iterations;
+  uint32_t width;
+  uint32_t height;
+  float_type min_re;
+  float_type max_re;
+  float_type min_im;
+  float_type max_im;
+
+  inline float_type re_factor() const {
+    return (max_re - min_re) / (width - 1);
+  }
+
+  inline float_type im_factor() const {
+    return (max_im - min_im) / (height - 1);
+  }
+
+  /// View of the rows [first, first + rows) with the same pixel spacing,
+  /// rows past the bottom of the image continue the plane.
+  mandelbrot_view band(uint32_t first, uint32_t rows) const;
+};
+
+/// Computes the iteration counts of the rows [first, last) of `view` on
+/// the CPU and stores them row by row at `out`. All kernels produce the
+/// same counts. With `skip_interior`, points in the main cardioid or the
+/// period-2 bulb and orbits that become periodic are not iterated further,
+/// which leaves the counts unchanged.
+void mandelbrot_rows(const mandelbrot_view& view, uint32_t first,
+                     uint32_t last, int* out,
+                     mandelbrot_kernel kernel = mandelbrot_kernel::simd,
+                     bool skip_interior = false);
+
+/// Computes the columns [first, last) of row `row` like `mandelbrot_rows`
+/// and stores them at `out + first`, i.e., `out` points to the row.
+void mandelbrot_span(const mandelbrot_view& view, uint32_t row,
+                     uint32_t first, uint32_t last, int* out,
+                     mandelbrot_kernel kernel = mandelbrot_kernel::simd,
+                     bool skip_interior = false);
+
+/// Computes the rows [first, last) of column `column` like
+/// `mandelbrot_rows` and stores them at `out + row * width`, i.e., `out`
+/// points to the column in the first row of the image.
+void mandelbrot_column(const mandelbrot_view& view, uint32_t column,
+                       uint32_t first, uint32_t last, int* out,
+                       mandelbrot_kernel kernel = mandelbrot_kernel::simd,
+                       bool skip_interior = false);
+
+#endif // MANDELBROT_HPP
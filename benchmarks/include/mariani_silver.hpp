@@ -0,0 +1,95 @@
+#ifndef MARIANI_SILVER_HPP
+#define MARIANI_SILVER_HPP
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+#include "include/mandelbrot.hpp"
+
+/// Rectangle of an image including its border, i.e., the pixels
+/// [x0, x1] x [y0, y1].
+struct ms_tile {
+  uint32_t x0;
+  uint32_t y0;
+  uint32_t x1;
+  uint32_t y1;
+
+  inline uint64_t inner_pixels() const {
+    return x1 - x0 < 2 || y1 - y0 < 2
+           ? 0 : uint64_t{x1 - x0 - 1} * (y1 - y0 - 1);
+  }
+};
+
+/// Pixels [first, last) of the row `fixed` or, if `vertical`, of the
+/// column `fixed` that still need to be computed.
+struct ms_line {
+  uint32_t fixed;
+  uint32_t first;
+  uint32_t last;
+  bool vertical;
+
+  /// Returns the index of pixel `i` in the image.
+  inline size_t at(uint32_t i, uint32_t width) const {
+    return vertical ? size_t{i} * width + fixed : size_t{fixed} * width + i;
+  }
+};
+
+/// Mariani-Silver subdivision of an image: if all pixels on the border of a
+/// tile have the same count, the inside gets that count without iterating.
+/// Otherwise, the tile is split into four by a cross through its middle.
+/// Tiles up to `min_size` pixels wide or high are computed completely.
+///
+/// A tile only writes pixels inside its border and its children share the
+/// cross, hence disjoint tiles may be processed concurrently once their
+/// borders are computed. Where the lines are computed is up to the caller.
+class mariani_silver {
+public:
+  mariani_silver(const mandelbrot_view& view, int* image, uint32_t min_size);
+
+  /// Returns the whole image as tile.
+  ms_tile root() const;
+
+  /// Appends the border of `t` to `lines`.
+  void border(const ms_tile& t, std::vector<ms_line>& lines) const;
+
+  /// Processes `t`, whose border must be computed. Fills the inside if the
+  /// border is uniform. Otherwise, appends the pixels that need computing to
+  /// `lines` and, if `t` is large enough, the four children to `children`.
+  /// The children may be processed once `lines` are computed.
+  void split(const ms_tile& t, std::vector<ms_line>& lines,
+             std::vector<ms_tile>& children);
+
+  /// Computes `lines` on the CPU.
+  void compute(const std::vector<ms_line>& lines, mandelbrot_kernel kernel,
+               bool skip_interior);
+
+  /// Stores `counts` for the pixels of `lines` in the same order.
+  void scatter(const std::vector<ms_line>& lines, const int* counts);
+
+  /// Number of pixels in `lines`.
+  static uint64_t pixels(const std::vector<ms_line>& lines);
+
+  /// Pixels that got computed so far.
+  inline uint64_t iterated() const {
+    return iterated_;
+  }
+
+  /// Pixels that got filled from a uniform border so far.
+  inline uint64_t filled() const {
+    return filled_;
+  }
+
+  inline const mandelbrot_view& view() const {
+    return view_;
+  }
+
+private:
+  mandelbrot_view view_;
+  int* image_;
+  uint32_t min_size_;
+  std::atomic<uint64_t> iterated_;
+  std::atomic<uint64_t> filled_;
+};
+
+#endif // MARIANI_SILVER_HPP
@@ -0,0 +1,36 @@
+#ifndef MEMORY_USAGE_HPP
+#define MEMORY_USAGE_HPP
+
+#include <cstdio>
+#include <cstddef>
+
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+/// Current resident set size of the process in bytes, 0 if unknown.
+inline size_t resident_bytes() {
+  auto f = fopen("/proc/self/statm", "r");
+  if (!f)
+    return 0;
+  long pages = 0;
+  long resident = 0;
+  auto n = fscanf(f, "%ld %ld", &pages, &resident);
+  fclose(f);
+  if (n != 2)
+    return 0;
+  return static_cast<size_t>(resident) * sysconf(_SC_PAGESIZE);
+}
+
+/// Peak resident set size of the process in bytes.
+inline size_t peak_resident_bytes() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return static_cast<size_t>(usage.ru_maxrss);
+#else
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+#endif // MEMORY_USAGE_HPP
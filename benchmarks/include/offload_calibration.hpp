@@ -0,0 +1,68 @@
+#ifndef OFFLOAD_CALIBRATION_HPP
+#define OFFLOAD_CALIBRATION_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "include/util.hpp"
+
+/// Default file for calibrated offload ratios.
+constexpr const char* default_calibration_cache = "offload.cache";
+
+/// Time a probe render took for the given number of iterations.
+struct probe_sample {
+  uint64_t iterations;
+  double ns;
+};
+
+/// Cost model of both sides, fitted from probe renders.
+struct offload_costs {
+  double cpu_ns_per_iteration = 0; // cost on a single CPU worker
+  size_t cpu_workers = 1;
+  double cl_overhead_ns = 0;       // launch and transfers of one job
+  double cl_ns_per_iteration = 0;
+};
+
+/// Fits `offload_costs` to one CPU sample measured on a single worker and
+/// a least squares line through the OpenCL samples.
+offload_costs fit_costs(const probe_sample& cpu, size_t cpu_workers,
+                        const std::vector<probe_sample>& cl);
+
+/// Sums the iteration counts of a `width` pixels wide image per column.
+std::vector<uint64_t> column_work(const std::vector<int>& counts,
+                                  uint32_t width);
+
+/// Predicts the makespan in ns of a render that offloads the right
+/// `percentage` of the columns. The column work stems from probe renders
+/// on each side, `scale` converts it to the full image.
+double predicted_makespan(const offload_costs& costs,
+                          const std::vector<uint64_t>& cpu_columns,
+                          const std::vector<uint64_t>& cl_columns,
+                          double scale, uint32_t percentage);
+
+/// Returns the percentage with the smallest predicted makespan.
+uint32_t best_offload(const offload_costs& costs,
+                      const std::vector<uint64_t>& cpu_columns,
+                      const std::vector<uint64_t>& cl_columns,
+                      double scale, double* makespan_ns = nullptr);
+
+/// Calibrated percentages stored in a text file with one tab separated line
+/// per device and problem. Later lines override earlier ones.
+class calibration_cache {
+public:
+  explicit calibration_cache(std::string path);
+
+  bool find(cl_device_id device, const std::string& problem,
+            uint32_t& percentage) const;
+
+  void store(cl_device_id device, const std::string& problem,
+             uint32_t percentage);
+
+private:
+  std::string path_;
+  std::map<std::string, uint32_t> entries_;
+};
+
+#endif // OFFLOAD_CALIBRATION_HPP
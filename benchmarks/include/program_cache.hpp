@@ -0,0 +1,40 @@
+#ifndef PROGRAM_CACHE_HPP
+#define PROGRAM_CACHE_HPP
+
+#include <string>
+
+#include "caf/opencl/all.hpp"
+
+#include "include/util.hpp"
+
+/// Default directory for compiled program binaries.
+constexpr const char* default_program_cache = "program-cache";
+
+/// Outcome of building a program, reported by the benchmarks.
+struct program_build_info {
+  bool cache_hit = false;
+  double build_us = 0; // time to load or compile the program
+};
+
+/// Builds `source` for `device`. If `cache_dir` is not empty, looks for a
+/// binary stored by a previous run for the same source, build options and
+/// device/driver and loads it with `clCreateProgramWithBinary`. A missing
+/// or rejected binary falls back to compiling the source and stores the
+/// result.
+program_ptr build_program(cl_context context, cl_device_id device,
+                          const char* source, const char* options,
+                          const std::string& cache_dir,
+                          program_build_info* info = nullptr);
+
+/// Counterpart of `manager::create_program` for OpenCL actors that uses
+/// the same binary cache.
+caf::opencl::program_ptr
+create_cached_program(const caf::opencl::device_ptr& dev, const char* source,
+                      const char* options, const std::string& cache_dir,
+                      program_build_info* info = nullptr);
+
+/// Prints `info` as `<label>, <hit|miss>, <microseconds>` to stderr.
+void print_build_info(const std::string& label,
+                      const program_build_info& info);
+
+#endif // PROGRAM_CACHE_HPP
@@ -0,0 +1,47 @@
+#ifndef REQUEST_TRACER_HPP
+#define REQUEST_TRACER_HPP
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+
+/// Host timestamps of one request to an OpenCL actor.
+struct request_trace {
+  using time_point = std::chrono::high_resolution_clock::time_point;
+  time_point sent;      // client enqueued the message to the actor
+  time_point submitted; // actor mapped the arguments, commands follow
+  time_point completed; // results are read back, actor maps the result
+  time_point delivered; // client received the result
+};
+
+/// Records a `request_trace` per request without modifying CAF. Clients
+/// prepend the ID returned by `sent` to the message, the argument mapping
+/// of the OpenCL actor strips it (`submitted`) and the result mapping
+/// appends it to the result again (`completed`). Results of an in-order
+/// queue complete in submission order.
+class request_tracer {
+public:
+  explicit request_tracer(size_t capacity);
+
+  uint64_t sent();
+
+  void submitted(uint64_t id);
+
+  uint64_t completed();
+
+  void delivered(uint64_t id);
+
+  /// Safe to call once all results have been delivered.
+  inline const std::vector<request_trace>& traces() const {
+    return traces_;
+  }
+
+private:
+  std::mutex mtx_;
+  std::deque<uint64_t> pending_;
+  std::vector<request_trace> traces_;
+};
+
+#endif // REQUEST_TRACER_HPP
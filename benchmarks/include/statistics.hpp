@@ -0,0 +1,37 @@
+#ifndef STATISTICS_HPP
+#define STATISTICS_HPP
+
+#include <cmath>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+/// Mean and percentiles of a series of measurements.
+struct summary {
+  double mean = 0;
+  double p50 = 0;
+  double p99 = 0;
+  double max = 0;
+};
+
+/// Nearest-rank percentile `p` (0 < p <= 100) of a sorted series.
+inline double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty())
+    return 0;
+  auto rank = static_cast<size_t>(std::ceil(p / 100 * sorted.size()));
+  return sorted[std::max(rank, size_t{1}) - 1];
+}
+
+inline summary summarize(std::vector<double> xs) {
+  summary result;
+  if (xs.empty())
+    return result;
+  std::sort(xs.begin(), xs.end());
+  result.mean = std::accumulate(xs.begin(), xs.end(), 0.0) / xs.size();
+  result.p50 = percentile(xs, 50);
+  result.p99 = percentile(xs, 99);
+  result.max = xs.back();
+  return result;
+}
+
+#endif // STATISTICS_HPP
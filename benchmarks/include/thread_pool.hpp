@@ -0,0 +1,88 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <functional>
+#include <condition_variable>
+
+/// Bounded multi-producer/multi-consumer queue without locks. Each slot
+/// carries a sequence number that tells producers and consumers whether it
+/// is free or filled for the current lap (see D. Vyukov's bounded queue).
+class task_queue {
+public:
+  using task = std::function<void()>;
+
+  /// Capacity is rounded up to the next power of two.
+  explicit task_queue(size_t capacity);
+
+  task_queue(const task_queue&) = delete;
+  task_queue& operator=(const task_queue&) = delete;
+
+  /// Returns false if the queue is full.
+  bool try_push(task& x);
+
+  /// Returns false if the queue is empty.
+  bool try_pop(task& x);
+
+private:
+  struct slot {
+    std::atomic<size_t> sequence;
+    task value;
+  };
+
+  std::vector<slot> slots_;
+  size_t mask_;
+  // padding keeps producers and consumers on separate cache lines
+  char pad0_[64];
+  std::atomic<size_t> enqueue_pos_;
+  char pad1_[64];
+  std::atomic<size_t> dequeue_pos_;
+};
+
+/// Fixed number of threads that execute tasks from a shared `task_queue`.
+/// Idle threads park on a condition variable, which submitters only touch
+/// when at least one thread sleeps.
+class thread_pool {
+public:
+  using task = task_queue::task;
+
+  explicit thread_pool(size_t threads, size_t queue_capacity = 4096);
+
+  ~thread_pool();
+
+  thread_pool(const thread_pool&) = delete;
+  thread_pool& operator=(const thread_pool&) = delete;
+
+  /// Enqueues `f`, runs pending tasks on the calling thread while the queue
+  /// is full.
+  void submit(task f);
+
+  /// Calls `f(begin, end)` for consecutive chunks of at most `chunk`
+  /// indexes in [first, last) and blocks until all chunks are done. The
+  /// calling thread helps executing tasks while it waits.
+  void parallel_for(size_t first, size_t last, size_t chunk,
+                    const std::function<void(size_t, size_t)>& f);
+
+  inline size_t size() const {
+    return threads_.size();
+  }
+
+private:
+  bool run_pending_task();
+
+  void run();
+
+  task_queue queue_;
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> pending_;
+  std::atomic<size_t> sleeping_;
+  std::atomic<bool> stop_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+};
+
+#endif // THREAD_POOL_HPP
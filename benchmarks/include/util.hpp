@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <type_traits>
 
+#include "caf/opencl/device.hpp"
 #include "caf/opencl/program.hpp"
 
 #if defined __APPLE__ || defined(MACOSX)
@@ -23,6 +24,11 @@ caf::opencl::program create_program(const std::string& dev_type,
                                     const char* source,
                                     const char* options = nullptr);
 
+/// Raw OpenCL handle of a device managed by CAF.
+inline cl_device_id raw_device_id(const caf::opencl::device_ptr& dev) {
+  return dev->get_device();
+}
+
 template<typename T, cl_int (*ref)(T), cl_int (*deref)(T)>
 class smart_ptr {
 
@@ -0,0 +1,48 @@
+#ifndef WORK_STEALING_HPP
+#define WORK_STEALING_HPP
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+
+/// Double-ended work queue of a single worker. The owner pushes and pops at
+/// the back (LIFO, keeps its caches warm), idle workers steal from the front.
+template <class T>
+class work_stealing_deque {
+public:
+  void push(T item) {
+    std::lock_guard<std::mutex> guard{mtx_};
+    items_.push_back(std::move(item));
+  }
+
+  bool pop(T& item) {
+    std::lock_guard<std::mutex> guard{mtx_};
+    if (items_.empty())
+      return false;
+    item = std::move(items_.back());
+    items_.pop_back();
+    return true;
+  }
+
+  bool steal(T& item) {
+    std::lock_guard<std::mutex> guard{mtx_};
+    if (items_.empty())
+      return false;
+    item = std::move(items_.front());
+    items_.pop_front();
+    return true;
+  }
+
+private:
+  std::mutex mtx_;
+  std::deque<T> items_;
+};
+
+/// Load balance counters of one worker, padded to avoid false sharing.
+struct alignas(64) worker_stats {
+  std::atomic<size_t> executed{0};
+  std::atomic<size_t> stolen{0};
+};
+
+#endif // WORK_STEALING_HPP
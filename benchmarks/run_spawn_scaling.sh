@@ -0,0 +1,64 @@
+#!/bin/bash
+
+actors=1000000
+spawners="1 2 4 8 16"
+threads="1 2 4 8 16"
+size=1000
+
+bench_root=".."
+
+usage="\
+Usage: $0
+    --actors        actors spawned per run (default: $actors)
+    --spawners      list of concurrent spawner counts (default: $spawners)
+    --threads       list of scheduler thread counts (default: $threads)
+    --size          problem size for the OpenCL actors (default: $size)
+    --help          print this text
+
+Prints one CSV line per run: spawners, scheduler threads, actors, runtime
+in us, actors/s, mean, p50 and p99 spawn latency in us, peak RSS in bytes.
+"
+
+while [ $# -ne 0 ]; do
+    case "$1" in
+        -*=*) optarg=`echo "$1" | sed 's/[-_a-zA-Z0-9]*=//'` ;;
+        *) optarg= ;;
+    esac
+
+    case "$1" in
+        --help|-h)
+            echo "${usage}" 1>&2
+            exit 1
+            ;;
+        --actors=*|-a=*)
+            actors=$optarg
+            ;;
+        --spawners=*)
+            spawners=$optarg
+            ;;
+        --threads=*)
+            threads=$optarg
+            ;;
+        --size=*|-s=*)
+            size=$optarg
+            ;;
+        *)
+            echo "Invalid option '$1'.  Try $0 --help to see available options."
+            exit 1
+            ;;
+    esac
+    shift
+done
+
+for i in spawn_core spawn_cl
+do
+    next_file="spawn_scaling_${i}.txt"
+    rm -f $next_file
+    for thread_count in $threads; do
+        for spawner_count in $spawners; do
+            echo "[executing] ${bench_root}/build/bin/bench_$i -s $size -i $actors -t $spawner_count --scheduler.max-threads=$thread_count >> $next_file"
+            ${bench_root}/build/bin/bench_$i -s $size -i $actors -t $spawner_count \
+                --scheduler.max-threads=$thread_count >> $next_file
+        done
+    done
+done
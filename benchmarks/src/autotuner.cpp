@@ -0,0 +1,221 @@
+#include <limits>
+#include <sstream>
+#include <fstream>
+#include <cstring>
+#include <iostream>
+
+#include "include/autotuner.hpp"
+
+using namespace std;
+
+namespace {
+
+string device_info(cl_device_id device, cl_device_info what) {
+  size_t size = 0;
+  auto err = clGetDeviceInfo(device, what, 0, nullptr, &size);
+  check_cl_error(err, "clGetDeviceInfo");
+  vector<char> buf(size + 1, '\0');
+  err = clGetDeviceInfo(device, what, size, buf.data(), nullptr);
+  check_cl_error(err, "clGetDeviceInfo");
+  return string(buf.data());
+}
+
+string join(const vector<size_t>& xs) {
+  if (xs.empty())
+    return "-";
+  ostringstream oss;
+  for (size_t i = 0; i < xs.size(); ++i)
+    oss << (i > 0 ? "," : "") << xs[i];
+  return oss.str();
+}
+
+// Parses the output of `join`, returns false if an element is not a number.
+bool split(const string& str, vector<size_t>& result) {
+  result.clear();
+  if (str == "-")
+    return true;
+  istringstream iss{str};
+  string x;
+  while (getline(iss, x, ',')) {
+    istringstream field{x};
+    size_t value = 0;
+    if (!(field >> value))
+      return false;
+    result.push_back(value);
+  }
+  return true;
+}
+
+// All local sizes that divide `global`, stay within the per-dimension limits
+// and do not exceed `max_group` work-items in total.
+void local_sizes(const vector<size_t>& global, const vector<size_t>& limits,
+                 size_t max_group, size_t dim, vector<size_t>& current,
+                 vector<vector<size_t>>& result) {
+  if (dim == global.size()) {
+    result.push_back(current);
+    return;
+  }
+  size_t group = 1;
+  for (auto x : current)
+    group *= x;
+  for (size_t l = 1; l <= limits[dim] && group * l <= max_group; l *= 2) {
+    if (global[dim] % l != 0)
+      break;
+    current.push_back(l);
+    local_sizes(global, limits, max_group, dim + 1, current, result);
+    current.pop_back();
+  }
+}
+
+} // namespace <anonymous>
+
+string device_identity(cl_device_id device) {
+  return device_info(device, CL_DEVICE_NAME) + " / "
+         + device_info(device, CL_DRIVER_VERSION);
+}
+
+tuning_cache::tuning_cache(string path) : path_(move(path)) {
+  ifstream in{path_};
+  string line;
+  while (getline(in, line)) {
+    istringstream iss{line};
+    string identity, problem, global, local;
+    launch_config config;
+    // skips truncated or otherwise malformed lines instead of failing on them
+    if (getline(iss, identity, '\t') && getline(iss, problem, '\t')
+        && getline(iss, config.kernel, '\t') && getline(iss, global, '\t')
+        && getline(iss, local, '\t') && iss >> config.runtime_us
+        && split(global, config.global) && split(local, config.local))
+      entries_[identity + '\t' + problem] = move(config);
+  }
+}
+
+bool tuning_cache::find(cl_device_id device, const string& problem,
+                        launch_config& config) const {
+  auto i = entries_.find(device_identity(device) + '\t' + problem);
+  if (i == entries_.end())
+    return false;
+  config = i->second;
+  return true;
+}
+
+void tuning_cache::store(cl_device_id device, const string& problem,
+                         const launch_config& config) {
+  auto identity = device_identity(device);
+  entries_[identity + '\t' + problem] = config;
+  ofstream out{path_, ios::app};
+  out << identity << '\t' << problem << '\t' << config.kernel << '\t'
+      << join(config.global) << '\t' << join(config.local) << '\t'
+      << config.runtime_us << endl;
+}
+
+launch_config autotune(cl_device_id device, const char* source,
+                       const vector<tuning_candidate>& candidates,
+                       const vector<tuning_arg>& args, size_t repetitions) {
+  cl_int err = 0;
+  context_ptr context;
+  context.adopt(clCreateContext(0, 1, &device, nullptr, nullptr, &err));
+  check_cl_error(err, "clCreateContext");
+  command_queue_ptr queue;
+  queue.adopt(clCreateCommandQueue(context.get(), device,
+                                   CL_QUEUE_PROFILING_ENABLE, &err));
+  check_cl_error(err, "clCreateCommandQueue");
+  size_t src_len = strlen(source);
+  program_ptr prog;
+  prog.adopt(clCreateProgramWithSource(context.get(), 1, &source, &src_len,
+                                       &err));
+  check_cl_error(err, "clCreateProgramWithSource");
+  err = clBuildProgram(prog.get(), 1, &device, nullptr, nullptr, nullptr);
+  check_cl_error(err, "clBuildProgram");
+  vector<mem_ptr> buffers;
+  for (auto& arg : args) {
+    cl_mem_flags flags = CL_MEM_READ_WRITE;
+    if (arg.data)
+      flags |= CL_MEM_COPY_HOST_PTR;
+    mem_ptr buf;
+    buf.adopt(clCreateBuffer(context.get(), flags, arg.bytes,
+                             const_cast<void*>(arg.data), &err));
+    check_cl_error(err, "clCreateBuffer");
+    buffers.push_back(move(buf));
+  }
+  vector<size_t> limits(3);
+  err = clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES,
+                        sizeof(size_t) * limits.size(), limits.data(),
+                        nullptr);
+  check_cl_error(err, "clGetDeviceInfo");
+  launch_config best;
+  best.runtime_us = numeric_limits<double>::max();
+  for (auto& candidate : candidates) {
+    kernel_ptr kernel;
+    kernel.adopt(clCreateKernel(prog.get(), candidate.kernel.c_str(), &err));
+    check_cl_error(err, "clCreateKernel");
+    for (cl_uint i = 0; i < buffers.size(); ++i) {
+      auto buf = buffers[i].get();
+      err = clSetKernelArg(kernel.get(), i, sizeof(cl_mem), &buf);
+      check_cl_error(err, "clSetKernelArg");
+    }
+    size_t max_group = 0;
+    err = clGetKernelWorkGroupInfo(kernel.get(), device,
+                                   CL_KERNEL_WORK_GROUP_SIZE,
+                                   sizeof(size_t), &max_group, nullptr);
+    check_cl_error(err, "clGetKernelWorkGroupInfo");
+    vector<vector<size_t>> configs;
+    if (candidate.fixed_local.empty()) {
+      configs.emplace_back(); // driver default
+      vector<size_t> current;
+      local_sizes(candidate.global, limits, max_group, 0, current, configs);
+    } else {
+      configs.push_back(candidate.fixed_local);
+    }
+    for (auto& local : configs) {
+      auto runtime = numeric_limits<double>::max();
+      for (size_t rep = 0; rep < repetitions; ++rep) {
+        event_ptr event;
+        cl_event raw_event;
+        err = clEnqueueNDRangeKernel(queue.get(), kernel.get(),
+                                     static_cast<cl_uint>(
+                                       candidate.global.size()),
+                                     nullptr, candidate.global.data(),
+                                     local.empty() ? nullptr : local.data(),
+                                     0, nullptr, &raw_event);
+        // the driver rejects configurations that exceed device resources
+        if (err != CL_SUCCESS)
+          break;
+        event.adopt(raw_event);
+        err = clWaitForEvents(1, &raw_event);
+        check_cl_error(err, "clWaitForEvents");
+        cl_ulong start = 0;
+        cl_ulong end = 0;
+        clGetEventProfilingInfo(raw_event, CL_PROFILING_COMMAND_START,
+                                sizeof(cl_ulong), &start, nullptr);
+        clGetEventProfilingInfo(raw_event, CL_PROFILING_COMMAND_END,
+                                sizeof(cl_ulong), &end, nullptr);
+        runtime = min(runtime, (end - start) / 1000.0);
+      }
+      if (runtime < best.runtime_us) {
+        best.kernel = candidate.kernel;
+        best.global = candidate.global;
+        best.local = local;
+        best.runtime_us = runtime;
+      }
+    }
+  }
+  if (best.kernel.empty())
+    throw runtime_error("autotune: no valid configuration found");
+  return best;
+}
+
+bool tuned_config(tuning_cache& cache, bool tune, cl_device_id device,
+                  const string& problem, const char* source,
+                  const vector<tuning_candidate>& candidates,
+                  const vector<tuning_arg>& args, launch_config& config) {
+  if (cache.find(device, problem, config))
+    return true;
+  if (!tune)
+    return false;
+  config = autotune(device, source, candidates, args);
+  cache.store(device, problem, config);
+  cerr << "tuned " << problem << ": " << config.kernel << " local "
+       << join(config.local) << " (" << config.runtime_us << " us)" << endl;
+  return true;
+}
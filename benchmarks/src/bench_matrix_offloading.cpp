@@ -1,7 +1,21 @@
 
+#include <limits>
+#include <atomic>
 #include <chrono>
+#include <memory>
+#include <numeric>
+#include <algorithm>
 
 #include "config.hpp"
+#include "autotuner.hpp"
+#include "image_sink.hpp"
+#include "mandelbrot.hpp"
+#include "statistics.hpp"
+#include "count_format.hpp"
+#include "memory_usage.hpp"
+#include "mariani_silver.hpp"
+#include "program_cache.hpp"
+#include "offload_calibration.hpp"
 
 #include "caf/all.hpp"
 #include "caf/opencl/all.hpp"
@@ -12,35 +26,173 @@ using namespace caf::opencl;
 
 namespace {
 
+// `mandelbrot_interior` skips points in the main cardioid and the period-2
+// bulb and stops once an orbit returns to a saved value exactly, the saved
+// value moves at powers of two (Brent). The results are the same as with
+// `mandelbrot`. `mandelbrot_points` computes a list of (x, y) pixels of the
+// image for the Mariani-Silver renderer. Contraction to FMA is disabled to
+// keep the arithmetic of all kernels identical. The build option
+// COUNT_FORMAT selects how the image kernels store counts, see
+// `count_format`. Each image kernel reads its configuration from a float
+// buffer and, as `_scalars` and `_struct` variant, from arguments passed
+// by value, see `kernel_args`.
 constexpr const char* kernel_source = R"__(
-  __kernel void mandelbrot(__global float* config,
-                           __global int* output) {
-    unsigned iterations = config[0];
-    unsigned width = config[1];
-    unsigned height = config[2];
-    float min_re = config[3];
-    float max_re = config[4];
-    float min_im = config[5];
-    float max_im = config[6];
-    float re_factor = (max_re - min_re) / (width - 1);
-    float im_factor = (max_im - min_im) / (height - 1);
-    unsigned x = get_global_id(0);
-    unsigned y = get_global_id(1);
-    float z_re = min_re + x * re_factor;
-    float z_im = max_im - y * im_factor;
+  #pragma OPENCL FP_CONTRACT OFF
+
+  #ifndef COUNT_FORMAT
+  #define COUNT_FORMAT 0
+  #endif
+
+  #if COUNT_FORMAT == 1
+  typedef ushort count_t;
+  #define ENCODE(cnt, iterations) ((ushort) min(cnt, 65535u))
+  #elif COUNT_FORMAT == 2
+  typedef uchar count_t;
+  #define ENCODE(cnt, iterations) \
+    ((cnt) < (iterations) ? (uchar) (0x80u | min(cnt, 127u)) : (uchar) 0)
+  #else
+  typedef int count_t;
+  #define ENCODE(cnt, iterations) ((int) (cnt))
+  #endif
+
+  typedef struct {
+    uint iterations;
+    uint width;
+    uint height;
+    float min_re;
+    float max_re;
+    float min_im;
+    float max_im;
+  } mandelbrot_config;
+
+  mandelbrot_config unpack(__global float* config) {
+    mandelbrot_config c;
+    c.iterations = config[0];
+    c.width = config[1];
+    c.height = config[2];
+    c.min_re = config[3];
+    c.max_re = config[4];
+    c.min_im = config[5];
+    c.max_im = config[6];
+    return c;
+  }
+
+  uint brute_force(mandelbrot_config c, uint x, uint y) {
+    float re_factor = (c.max_re - c.min_re) / (c.width - 1);
+    float im_factor = (c.max_im - c.min_im) / (c.height - 1);
+    float z_re = c.min_re + x * re_factor;
+    float z_im = c.max_im - y * im_factor;
     float const_re = z_re;
     float const_im = z_im;
-    unsigned cnt = 0;
+    uint cnt = 0;
     float cond = 0;
     do {
       float tmp_re = z_re;
       float tmp_im = z_im;
       z_re = ( tmp_re * tmp_re - tmp_im * tmp_im ) + const_re;
       z_im = ( 2 * tmp_re * tmp_im ) + const_im;
-      cond = (z_re - z_im) * (z_re - z_im);
+      cond = z_re * z_re + z_im * z_im;
       ++cnt;
-    } while (cnt < iterations && cond <= 4.0f);
-    output[x+y*width] = cnt;
+    } while (cnt < c.iterations && cond <= 4.0f);
+    return cnt;
+  }
+
+  uint interior(mandelbrot_config c, uint x, uint y) {
+    float re_factor = (c.max_re - c.min_re) / (c.width - 1);
+    float im_factor = (c.max_im - c.min_im) / (c.height - 1);
+    float z_re = c.min_re + x * re_factor;
+    float z_im = c.max_im - y * im_factor;
+    float const_re = z_re;
+    float const_im = z_im;
+    uint limit = max(c.iterations, 1u);
+    float q_re = const_re - 0.25f;
+    float im2 = const_im * const_im;
+    float q = q_re * q_re + im2;
+    float bulb_re = const_re + 1.0f;
+    if (q * (q + q_re) < 0.25f * im2
+        || bulb_re * bulb_re + im2 < 0.0625f)
+      return limit;
+    float saved_re = z_re;
+    float saved_im = z_im;
+    uint next_save = 2;
+    uint cnt = 0;
+    float cond = 0;
+    do {
+      float tmp_re = z_re;
+      float tmp_im = z_im;
+      z_re = ( tmp_re * tmp_re - tmp_im * tmp_im ) + const_re;
+      z_im = ( 2 * tmp_re * tmp_im ) + const_im;
+      cond = z_re * z_re + z_im * z_im;
+      ++cnt;
+      if (cond <= 4.0f) {
+        if (z_re == saved_re && z_im == saved_im)
+          return limit;
+        if (cnt == next_save) {
+          saved_re = z_re;
+          saved_im = z_im;
+          next_save *= 2;
+        }
+      }
+    } while (cnt < c.iterations && cond <= 4.0f);
+    return cnt;
+  }
+
+  void store_brute_force(mandelbrot_config c, __global count_t* output) {
+    uint x = get_global_id(0);
+    uint y = get_global_id(1);
+    output[x+y*c.width] = ENCODE(brute_force(c, x, y), c.iterations);
+  }
+
+  void store_interior(mandelbrot_config c, __global count_t* output) {
+    uint x = get_global_id(0);
+    uint y = get_global_id(1);
+    output[x+y*c.width] = ENCODE(interior(c, x, y), c.iterations);
+  }
+
+  __kernel void mandelbrot(__global float* config,
+                           __global count_t* output) {
+    store_brute_force(unpack(config), output);
+  }
+
+  __kernel void mandelbrot_scalars(uint iterations, uint width, uint height,
+                                   float min_re, float max_re,
+                                   float min_im, float max_im,
+                                   __global count_t* output) {
+    mandelbrot_config c = {iterations, width, height,
+                           min_re, max_re, min_im, max_im};
+    store_brute_force(c, output);
+  }
+
+  __kernel void mandelbrot_struct(mandelbrot_config config,
+                                  __global count_t* output) {
+    store_brute_force(config, output);
+  }
+
+  __kernel void mandelbrot_interior(__global float* config,
+                                    __global count_t* output) {
+    store_interior(unpack(config), output);
+  }
+
+  __kernel void mandelbrot_interior_scalars(uint iterations, uint width,
+                                            uint height,
+                                            float min_re, float max_re,
+                                            float min_im, float max_im,
+                                            __global count_t* output) {
+    mandelbrot_config c = {iterations, width, height,
+                           min_re, max_re, min_im, max_im};
+    store_interior(c, output);
+  }
+
+  __kernel void mandelbrot_interior_struct(mandelbrot_config config,
+                                           __global count_t* output) {
+    store_interior(config, output);
+  }
+
+  __kernel void mandelbrot_points(__global float* config,
+                                  __global int* points,
+                                  __global int* output) {
+    uint i = get_global_id(0);
+    output[i] = brute_force(unpack(config), points[2 * i], points[2 * i + 1]);
   }
 )__";
 
@@ -53,10 +205,84 @@ constexpr const char* kernel_source = R"__(
 } // namespace <anonymous>
 
 using ack_atom = atom_constant<atom("ack")>;
+using band_atom = atom_constant<atom("band")>;
+
+// kernels selected on the command line
+struct render_kernels {
+  mandelbrot_kernel cpu;
+  bool skip_interior;
+
+  inline const char* cl_name() const {
+    return skip_interior ? "mandelbrot_interior" : "mandelbrot";
+  }
+};
+
+// how the image kernels receive their configuration
+enum class kernel_args {
+  buffer,   // a float buffer, see `make_cljob`
+  scalars,  // one argument per field of `mandelbrot_args`
+  structure // `mandelbrot_args` as a single argument
+};
+
+bool parse_kernel_args(const string& name, kernel_args& args) {
+  if (name == "buffer")
+    args = kernel_args::buffer;
+  else if (name == "scalars")
+    args = kernel_args::scalars;
+  else if (name == "struct")
+    args = kernel_args::structure;
+  else
+    return false;
+  return true;
+}
+
+const char* to_string(kernel_args args) {
+  switch (args) {
+    case kernel_args::scalars:
+      return "scalars";
+    case kernel_args::structure:
+      return "struct";
+    default:
+      return "buffer";
+  }
+}
+
+// suffix of the kernel variant that receives `args`
+const char* kernel_suffix(kernel_args args) {
+  switch (args) {
+    case kernel_args::scalars:
+      return "_scalars";
+    case kernel_args::structure:
+      return "_struct";
+    default:
+      return "";
+  }
+}
+
+// configuration of the image kernels, the layout matches
+// `mandelbrot_config` in the kernel source
+struct mandelbrot_args {
+  cl_uint iterations;
+  cl_uint width;
+  cl_uint height;
+  cl_float min_re;
+  cl_float max_re;
+  cl_float min_im;
+  cl_float max_im;
+};
+
+template <class Inspector>
+typename Inspector::result_type inspect(Inspector& f, mandelbrot_args& x) {
+  return f(meta::type_name("mandelbrot_args"), x.iterations, x.width,
+           x.height, x.min_re, x.max_re, x.min_im, x.max_im);
+}
 
 // how much of the problem is offloaded to the OpenCL device
 unsigned long with_opencl = 0;
 
+// default of `with-opencl`, tells an explicit 0 apart from a missing option
+constexpr uint32_t unset_offload = numeric_limits<uint32_t>::max();
+
 // global values to track the time
 chrono::system_clock::time_point cpu_start;
 chrono::system_clock::time_point opencl_start;
@@ -67,9 +293,135 @@ chrono::system_clock::time_point total_end;
 unsigned long time_opencl = 0;
 unsigned long time_cpu = 0;
 
-// calculates mandelbrot with OpenCL
+opencl::device_ptr find_device(opencl::manager& mngr,
+                               const string& device_name) {
+  auto opt = mngr.find_device_if([&](const opencl::device_ptr dev) {
+    if (device_name.empty())
+      return true;
+    return dev->name() == device_name;
+  });
+  if (!opt)
+    throw std::runtime_error("No device called '" + device_name + "' found.");
+  return *opt;
+}
+
+// argument of the mandelbrot kernel
+vector<float_type> make_cljob(const mandelbrot_view& view) {
+  return {
+    static_cast<float_type>(view.iterations),
+    static_cast<float_type>(view.width),
+    static_cast<float_type>(view.height),
+    view.min_re, view.max_re,
+    view.min_im, view.max_im
+  };
+}
+
+// message to an actor of `spawn_image_kernel`, unlike the float buffer it
+// keeps integers above 2^24 exact
+mandelbrot_args make_clargs(const mandelbrot_view& view) {
+  return {
+    view.iterations, view.width, view.height,
+    view.min_re, view.max_re,
+    view.min_im, view.max_im
+  };
+}
+
+// spawns an OpenCL actor for the image kernel `kernel_name` that receives
+// `mandelbrot_args`, passes them to the kernel as selected by `args` and
+// responds with counts of type `T`, mapped by `map_result`
+template<typename T, typename F>
+actor spawn_image_kernel(opencl::manager& mngr,
+                         const opencl::program_ptr& prog,
+                         const string& kernel_name, kernel_args args,
+                         const nd_range& ndr, F map_result) {
+  auto name = kernel_name + kernel_suffix(args);
+  switch (args) {
+    case kernel_args::scalars: {
+      auto map_args = [](message& msg) -> optional<message> {
+        if (!msg.match_elements<mandelbrot_args>())
+          return none;
+        auto& x = msg.get_as<mandelbrot_args>(0);
+        return make_message(x.iterations, x.width, x.height,
+                            x.min_re, x.max_re, x.min_im, x.max_im);
+      };
+      return mngr.spawn(prog, name.c_str(), ndr, map_args, map_result,
+                        priv<cl_uint>{}, priv<cl_uint>{}, priv<cl_uint>{},
+                        priv<cl_float>{}, priv<cl_float>{},
+                        priv<cl_float>{}, priv<cl_float>{}, out<T>{});
+    }
+    case kernel_args::structure: {
+      auto map_args = [](message& msg) -> optional<message> {
+        return msg;
+      };
+      return mngr.spawn(prog, name.c_str(), ndr, map_args, map_result,
+                        priv<mandelbrot_args>{}, out<T>{});
+    }
+    default: {
+      auto map_args = [](message& msg) -> optional<message> {
+        if (!msg.match_elements<mandelbrot_args>())
+          return none;
+        auto& x = msg.get_as<mandelbrot_args>(0);
+        return make_message(vector<float_type>{
+          static_cast<float_type>(x.iterations),
+          static_cast<float_type>(x.width),
+          static_cast<float_type>(x.height),
+          x.min_re, x.max_re, x.min_im, x.max_im
+        });
+      };
+      return mngr.spawn(prog, name.c_str(), ndr, map_args, map_result,
+                        in<float_type>{}, out<T>{});
+    }
+  }
+}
+
+template<typename T>
+actor spawn_image_kernel(opencl::manager& mngr,
+                         const opencl::program_ptr& prog,
+                         const string& kernel_name, kernel_args args,
+                         const nd_range& ndr) {
+  auto map_result = [](vector<T> result) -> message {
+    return make_message(move(result));
+  };
+  return spawn_image_kernel<T>(mngr, prog, kernel_name, args, ndr,
+                               map_result);
+}
+
+// launch dimensions for the pixels of `view`, tuned if requested
+nd_range mandelbrot_range(const opencl::device_ptr& dev,
+                          const string& kernel_name, bool tune,
+                          const string& tuning_cache_path,
+                          const mandelbrot_view& view) {
+  auto iterations = view.iterations;
+  auto width = view.width;
+  auto height = view.height;
+  auto cljob = make_cljob(view);
+  launch_config launch;
+  launch.kernel = kernel_name;
+  launch.global = {width, height};
+  {
+    tuning_cache cache{tuning_cache_path};
+    tuned_config(cache, tune, raw_device_id(dev),
+                 kernel_name + "/" + to_string(width) + "x" + to_string(height)
+                 + "/" + to_string(iterations),
+                 kernel_source,
+                 {tuning_candidate{launch.kernel, launch.global, {}}},
+                 {tuning_arg{sizeof(float_type) * cljob.size(), cljob.data()},
+                  tuning_arg{sizeof(int) * size_t{width} * height, nullptr}},
+                 launch);
+  }
+  return to_nd_range(launch);
+}
+
+// calculates mandelbrot with OpenCL, the kernel writes counts of type `T`
+template<typename T>
 void mandel_cl(event_based_actor* self,
                const string& device_name,
+               bool tune,
+               const string& tuning_cache_path,
+               const string& program_cache,
+               const string& kernel_name,
+               count_format format,
+               kernel_args args,
                uint32_t iterations,
                uint32_t width,
                uint32_t height,
@@ -78,41 +430,263 @@ void mandel_cl(event_based_actor* self,
                float_type min_imag,
                float_type max_imag) {
   auto& mngr = self->system().opencl_manager();
-  auto opt = mngr.find_device_if([&](const opencl::device_ptr dev) {
-    if (device_name.empty())
-      return true;
-    return dev->name() == device_name;
-  });
-  if (!opt)
-    throw std::runtime_error("No device called '" + device_name + "' found.");
-  auto dev = *opt;
-  auto prog = mngr.create_program(kernel_source, "", dev);
-  auto unbox_args = [](message& msg) -> optional<message> {
-    return msg;
-  };
-  auto box_res = [&] (vector<int> result) -> message {
+  auto dev = find_device(mngr, device_name);
+  program_build_info build_info;
+  auto prog = create_cached_program(dev, kernel_source,
+                                    count_format_options(format),
+                                    program_cache, &build_info);
+  print_build_info("program", build_info);
+  auto box_res = [&] (vector<T> result) -> message {
     opencl_end = std::chrono::system_clock::now();
     return make_message(move(result));
   };
-  vector<float_type> cljob {
-    static_cast<float_type>(iterations),
-    static_cast<float_type>(width),
-    static_cast<float_type>(height),
-    min_real, max_real,
-    min_imag, max_imag
-  };
-  nd_range ndr{dim_vec{width, height}};
+  mandelbrot_view view{iterations, width, height,
+                       min_real, max_real, min_imag, max_imag};
+  auto ndr = mandelbrot_range(dev, kernel_name, tune, tuning_cache_path,
+                              view);
   opencl_start = chrono::system_clock::now();
-  auto clworker = mngr.spawn(prog, "mandelbrot", ndr, unbox_args, box_res,
-                             in<float_type>{}, out<int>{});
-  self->request(clworker, infinite, move(cljob)).then (
-    [=](const vector<int>& result) {
+  auto clworker = spawn_image_kernel<T>(mngr, prog, kernel_name, args, ndr,
+                                        box_res);
+  self->request(clworker, infinite, make_clargs(view)).then (
+    [=](const vector<T>& result) {
       static_cast<void>(result);
       DEBUG("Mandelbrot with OpenCL calculated");
     }
   );
 }
 
+// Row bands of an image handed out to CPU and OpenCL workers. Every worker
+// takes the next band of its preferred height until all rows are taken.
+class band_queue {
+public:
+  explicit band_queue(uint32_t rows) : next_(0), rows_(rows) {
+    // nop
+  }
+
+  // Returns false if no rows are left.
+  bool take(uint32_t band_rows, uint32_t& first, uint32_t& last) {
+    auto x = next_.fetch_add(band_rows);
+    if (x >= rows_)
+      return false;
+    first = x;
+    last = min(x + band_rows, rows_);
+    return true;
+  }
+
+private:
+  atomic<uint32_t> next_;
+  uint32_t rows_;
+};
+
+// Bands completed by the workers of one side, the last worker to run out
+// of bands records the end time.
+struct band_stats {
+  atomic<size_t> bands{0};
+  atomic<size_t> rows{0};
+  atomic<size_t> active{0};
+  chrono::system_clock::time_point end;
+
+  void finish() {
+    if (--active == 0)
+      end = chrono::system_clock::now();
+  }
+};
+
+// pulls bands of `band_rows` rows and computes them on the CPU, either
+// into `image` or into a band buffer that goes to `sink`
+behavior cpu_band_worker(event_based_actor* self, band_queue* queue,
+                         band_stats* stats, mandelbrot_view view,
+                         uint32_t band_rows, render_kernels kernels,
+                         int* image, image_sink* sink) {
+  auto band = make_shared<vector<int>>(sink ? size_t{band_rows} * view.width
+                                            : 0);
+  self->send(self, band_atom::value);
+  return {
+    [=](band_atom) {
+      uint32_t first;
+      uint32_t last;
+      if (!queue->take(band_rows, first, last)) {
+        stats->finish();
+        self->quit();
+        return;
+      }
+      if (sink) {
+        mandelbrot_rows(view, first, last, band->data(), kernels.cpu,
+                        kernels.skip_interior);
+        sink->write_rows(first, last - first, band->data());
+      } else {
+        mandelbrot_rows(view, first, last, image + size_t{first} * view.width,
+                        kernels.cpu, kernels.skip_interior);
+      }
+      ++stats->bands;
+      stats->rows += last - first;
+      self->send(self, band_atom::value);
+    }
+  };
+}
+
+// returns the first `n` counts of `xs`, decoded into `buf` if necessary
+inline const int* decoded(const vector<int>& xs, size_t, uint32_t,
+                          vector<int>&) {
+  return xs.data();
+}
+
+template<typename T>
+const int* decoded(const vector<T>& xs, size_t n, uint32_t iterations,
+                   vector<int>& buf) {
+  buf.resize(n);
+  decode_counts(xs.data(), n, iterations, buf.data());
+  return buf.data();
+}
+
+template<typename T>
+void pull_cl_band(event_based_actor* self, actor worker, band_queue* queue,
+                  band_stats* stats, mandelbrot_view view,
+                  uint32_t band_rows, int* image, image_sink* sink) {
+  uint32_t first;
+  uint32_t last;
+  if (!queue->take(band_rows, first, last)) {
+    stats->finish();
+    return;
+  }
+  // the kernel always computes full bands, rows past the image are dropped
+  auto clargs = make_clargs(view.band(first, band_rows));
+  self->request(worker, infinite, clargs).then(
+    [=](const vector<T>& result) {
+      auto n = size_t{last - first} * view.width;
+      if (sink) {
+        vector<int> buf;
+        sink->write_rows(first, last - first,
+                         decoded(result, n, view.iterations, buf));
+      } else {
+        decode_counts(result.data(), n, view.iterations,
+                      image + size_t{first} * view.width);
+      }
+      ++stats->bands;
+      stats->rows += last - first;
+      pull_cl_band<T>(self, worker, queue, stats, view, band_rows, image,
+                      sink);
+    }
+  );
+}
+
+// pulls bands of `band_rows` rows and sends them to an OpenCL actor that
+// writes counts of type `T`
+template<typename T>
+void cl_band_worker(event_based_actor* self, actor worker, band_queue* queue,
+                    band_stats* stats, mandelbrot_view view,
+                    uint32_t band_rows, int* image, image_sink* sink) {
+  pull_cl_band<T>(self, worker, queue, stats, view, band_rows, image, sink);
+}
+
+// Rows per tile of one CPU worker, adapted to the measured cost so that a
+// tile takes about `target_us`: tiles are split after running slow and
+// merged after running cheap. Neighboring rows cost about the same, i.e.,
+// the last tile predicts the next one.
+class adaptive_grain {
+public:
+  adaptive_grain(uint32_t max_rows, double target_us)
+      : rows_(1),
+        max_rows_(max(max_rows, uint32_t{1})),
+        target_us_(target_us) {
+    // nop
+  }
+
+  inline uint32_t rows() const {
+    return rows_;
+  }
+
+  void update(double us) {
+    if (us > 2 * target_us_)
+      rows_ = max(rows_ / 2, uint32_t{1});
+    else if (us < target_us_ / 2)
+      rows_ = min(rows_ * 2, max_rows_);
+  }
+
+private:
+  uint32_t rows_;
+  uint32_t max_rows_;
+  double target_us_;
+};
+
+// Progress of the CPU part, shared by all of its tasks. Only the task that
+// completes the last row notifies the listener.
+struct tile_stats {
+  atomic<uint32_t> rows_left{0};
+  atomic<size_t> tiles{0};
+  atomic<uint64_t> compute_ns{0};
+
+  // returns true if `rows` were the last rows
+  bool complete(uint32_t rows, chrono::steady_clock::time_point start) {
+    compute_ns += chrono::duration_cast<chrono::nanoseconds>(
+      chrono::steady_clock::now() - start
+    ).count();
+    ++tiles;
+    return rows_left.fetch_sub(rows) == rows;
+  }
+};
+
+// pulls tiles of adaptive height from `queue` until all rows are taken
+behavior cpu_tile_worker(event_based_actor* self, band_queue* queue,
+                         tile_stats* stats, mandelbrot_view view,
+                         uint32_t max_rows, double target_us,
+                         render_kernels kernels, int* image,
+                         actor listener) {
+  auto grain = make_shared<adaptive_grain>(max_rows, target_us);
+  self->send(self, band_atom::value);
+  return {
+    [=](band_atom) {
+      uint32_t first;
+      uint32_t last;
+      if (!queue->take(grain->rows(), first, last)) {
+        self->quit();
+        return;
+      }
+      auto start = chrono::steady_clock::now();
+      mandelbrot_rows(view, first, last, image + size_t{first} * view.width,
+                      kernels.cpu, kernels.skip_interior);
+      if (stats->complete(last - first, start))
+        anon_send(listener, ack_atom::value);
+      // a tile cut short at the bottom of the image is scaled up
+      grain->update(chrono::duration_cast<chrono::microseconds>(
+        chrono::steady_clock::now() - start
+      ).count() * static_cast<double>(grain->rows()) / (last - first));
+      self->send(self, band_atom::value);
+    }
+  };
+}
+
+// tiles with at least this many inner pixels become separate tasks
+constexpr uint64_t ms_task_pixels = 128 * 128;
+
+// processes `t` and its children with Mariani-Silver subdivision, spawns
+// large children as new tasks. The last task to finish notifies `listener`.
+void ms_task(event_based_actor* self, mariani_silver* ms,
+             render_kernels kernels, atomic<size_t>* pending, actor listener,
+             ms_tile t) {
+  vector<ms_tile> todo{t};
+  vector<ms_line> lines;
+  vector<ms_tile> children;
+  while (!todo.empty()) {
+    auto tile = todo.back();
+    todo.pop_back();
+    lines.clear();
+    children.clear();
+    ms->split(tile, lines, children);
+    ms->compute(lines, kernels.cpu, kernels.skip_interior);
+    for (auto& child : children) {
+      if (child.inner_pixels() >= ms_task_pixels) {
+        ++*pending;
+        self->system().spawn(ms_task, ms, kernels, pending, listener, child);
+      } else {
+        todo.push_back(child);
+      }
+    }
+  }
+  if (--*pending == 0)
+    anon_send(listener, ack_atom::value);
+}
+
 template<typename T>
 T get_cut(T start, T end, uint32_t percentage) {
   auto dist = (abs(start) + abs(end)) * percentage / 100.0;
@@ -135,7 +709,34 @@ public:
   size_t iterations = default_iterations;
   uint32_t width = default_width;
   uint32_t height = default_height;
-  uint32_t offloaded = 0;
+  uint32_t offloaded = unset_offload;
+  bool tune = false;
+  string tuning_cache = "tuning.cache";
+  string program_cache = default_program_cache;
+  bool dynamic = false;
+  uint32_t cpu_band = 4;
+  uint32_t cl_band = 256;
+  size_t cpu_workers = 0;
+  size_t cl_workers = 1;
+  bool calibrate = false;
+  bool compare_static = false;
+  string cpu_kernel = "simd";
+  string cpu_tasks = "adaptive";
+  bool skip_interior = false;
+  bool verify = false;
+  bool mariani_silver = false;
+  bool ms_opencl = false;
+  uint32_t ms_min_size = 8;
+  double tile_us = 1000;
+  string calibration_cache = default_calibration_cache;
+  string output;
+  string output_format = "pgm";
+  string counts = "int32";
+  bool compare_counts = false;
+  string cl_args = "buffer";
+  bool compare_args = false;
+  uint32_t args_size = 64;
+  size_t args_requests = 1000;
   config() {
     load<opencl::manager>();
     opt_group{custom_options_, "global"}
@@ -144,94 +745,660 @@ public:
     .add(width, "width,W", "set width (16000)")
     .add(height, "height,H", "set height (16000")
     .add(iterations, "iterations,i", "set iterations (deault: 500)")
-    .add(offloaded,"with-opencl,o", "part calculated with OpenCL in % (0)");
+    .add(offloaded,"with-opencl,o", "part calculated with OpenCL in % (0)")
+    .add(tune, "tune", "run the autotuner if the tuning cache has no entry")
+    .add(tuning_cache, "tuning-cache", "file with tuned launch configurations "
+                                       "(tuning.cache)")
+    .add(program_cache, "program-cache", "directory for compiled program "
+                                         "binaries, empty disables it "
+                                         "(program-cache)")
+    .add(dynamic, "dynamic", "let CPU and OpenCL workers pull row bands "
+                             "from a shared queue instead of a static split")
+    .add(cpu_band, "cpu-band", "rows per band of a CPU worker (4)")
+    .add(cl_band, "cl-band", "rows per band of an OpenCL worker (256)")
+    .add(cpu_workers, "cpu-workers", "CPU workers in dynamic and adaptive "
+                                     "mode, 0 uses one per scheduler "
+                                     "thread (0)")
+    .add(cl_workers, "cl-workers", "OpenCL workers in dynamic mode, 0 "
+                                   "computes on the CPU only (1)")
+    .add(cpu_kernel, "cpu-kernel", "CPU kernel: scalar or simd (simd)")
+    .add(cpu_tasks, "cpu-tasks", "CPU decomposition: rows (one actor per "
+                                 "row) or adaptive (adaptive)")
+    .add(tile_us, "tile-us", "target runtime of an adaptive tile in us "
+                             "(1000)")
+    .add(skip_interior, "skip-interior", "skip cardioid, bulb and periodic "
+                                         "points on CPU and OpenCL")
+    .add(verify, "verify", "compare the results of brute force and "
+                           "skip-interior on a probe image and exit")
+    .add(mariani_silver, "mariani-silver", "compare a full render with "
+                                           "Mariani-Silver subdivision")
+    .add(ms_opencl, "ms-opencl", "compute Mariani-Silver borders with one "
+                                 "OpenCL launch per level instead of CPU "
+                                 "tasks")
+    .add(ms_min_size, "ms-min-size", "tiles up to this size are computed "
+                                     "without subdivision (8)")
+    .add(calibrate, "calibrate", "choose with-opencl from probe renders on "
+                                 "both sides instead of taking it as input")
+    .add(calibration_cache, "calibration-cache", "file with calibrated "
+                                                 "offload ratios "
+                                                 "(offload.cache)")
+    .add(compare_static, "compare-static", "render once more with a static "
+                                           "split after dynamic mode and "
+                                           "compare both totals, the split "
+                                           "is calibrated unless "
+                                           "with-opencl is given")
+    .add(output, "output", "stream the bands of dynamic mode into this "
+                           "memory-mapped file instead of keeping the "
+                           "image in memory")
+    .add(output_format, "output-format", "layout of the output file: pgm "
+                                         "or raw (pgm)")
+    .add(counts, "counts", "counts written by the OpenCL kernel: int32, "
+                           "uint16 or uint8 (int32)")
+    .add(compare_counts, "compare-counts", "compare the transfer of all "
+                                           "count formats on the OpenCL "
+                                           "device and exit")
+    .add(cl_args, "cl-args", "configuration of the OpenCL kernel: buffer, "
+                             "scalars or struct (buffer)")
+    .add(compare_args, "compare-args", "compare the request latency of all "
+                                       "ways to pass the configuration and "
+                                       "exit")
+    .add(args_size, "args-size", "width and height of the frames of "
+                                 "compare-args (64)")
+    .add(args_requests, "args-requests", "requests per variant of "
+                                         "compare-args (1000)");
+    add_message_type<mandelbrot_args>("mandelbrot_args");
   }
 };
 
-void caf_main(actor_system& system, const config& cfg) {
-  total_start = chrono::system_clock::now();
-  with_opencl = cfg.offloaded;
-  auto iterations = cfg.iterations;
-  auto on_cpu  = 100 - cfg.offloaded;
-  auto min_re  = default_min_real;
-  auto max_re  = default_max_real;
-  auto min_im  = default_min_imag;
-  auto max_im  = default_max_imag;
+// width and height of the probe renders used for calibration
+constexpr uint32_t probe_size = 256;
 
-  auto scale = [&](const float_type ratio) {
-    float_type abs_re = fabs(max_re + (-1 * min_re)) / 2;
-    float_type abs_im = fabs(max_im + (-1 * min_im)) / 2;
-    float_type mid_re = min_re + abs_re;
-    float_type mid_im = min_im + abs_im;
-    auto dist = abs_re * ratio;
-    min_re = mid_re - dist;
-    max_re = mid_re + dist;
-    min_im = mid_im - dist;
-    max_im = mid_im + dist;
+// renders downscaled probes of `view` on a single CPU worker and on the
+// OpenCL device, fits the cost of an iteration on both sides and returns
+// the offloaded percentage with the smallest predicted makespan
+uint32_t calibrate_offload(actor_system& system, const config& cfg,
+                           const mandelbrot_view& view,
+                           render_kernels kernels) {
+  auto& mngr = system.opencl_manager();
+  auto dev = find_device(mngr, cfg.device_name);
+  // the same CPU workers as the static path renders with
+  auto workers = cfg.cpu_workers > 0 ? cfg.cpu_workers
+                                     : cfg.scheduler_max_threads;
+  auto problem = "mandelbrot/" + to_string(view.width) + "x"
+                 + to_string(view.height) + "/" + to_string(view.iterations)
+                 + "/" + to_string(workers) + "/" + to_string(kernels.cpu)
+                 + "/" + kernels.cl_name();
+  calibration_cache cache{cfg.calibration_cache};
+  uint32_t percentage = 0;
+  if (cache.find(raw_device_id(dev), problem, percentage)) {
+    cerr << "calibration, hit, " << percentage << endl;
+    return percentage;
+  }
+  auto probe = view;
+  probe.width = min(view.width, probe_size);
+  probe.height = min(view.height, probe_size);
+  auto sum = [](const vector<int>& counts) {
+    return accumulate(counts.begin(), counts.end(), uint64_t{0});
   };
-  scale(default_scaling);
+  auto ns_since = [](chrono::steady_clock::time_point start) {
+    return static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(
+      chrono::steady_clock::now() - start
+    ).count());
+  };
+  vector<int> cpu_counts(size_t{probe.width} * probe.height);
+  auto start = chrono::steady_clock::now();
+  mandelbrot_rows(probe, 0, probe.height, cpu_counts.data(), kernels.cpu,
+                  kernels.skip_interior);
+  probe_sample cpu{sum(cpu_counts), ns_since(start)};
+  program_build_info build_info;
+  auto prog = create_cached_program(dev, kernel_source, "", cfg.program_cache,
+                                    &build_info);
+  print_build_info("program", build_info);
+  scoped_actor self{system};
+  // keeps the fastest of a few runs, the first one also warms up the device
+  auto run_cl = [&](const mandelbrot_view& v, vector<int>& counts) {
+    auto worker = mngr.spawn(prog, kernels.cl_name(),
+                             nd_range{dim_vec{v.width, v.height}},
+                             in<float_type>{}, out<int>{});
+    auto best = numeric_limits<double>::max();
+    for (int i = 0; i < 3; ++i) {
+      auto start = chrono::steady_clock::now();
+      self->send(worker, make_cljob(v));
+      self->receive(
+        [&](vector<int>& result) {
+          counts = move(result);
+        }
+      );
+      best = min(best, ns_since(start));
+    }
+    anon_send_exit(worker, exit_reason::user_shutdown);
+    return best;
+  };
+  // two probe sizes separate the launch overhead from the per-iteration cost
+  vector<probe_sample> cl;
+  vector<int> cl_counts;
+  auto ns = run_cl(probe.band(0, max(probe.height / 4, uint32_t{2})),
+                   cl_counts);
+  cl.push_back(probe_sample{sum(cl_counts), ns});
+  ns = run_cl(probe, cl_counts);
+  cl.push_back(probe_sample{sum(cl_counts), ns});
+  auto costs = fit_costs(cpu, workers, cl);
+  auto scale = static_cast<double>(view.width) * view.height
+               / (static_cast<double>(probe.width) * probe.height);
+  double makespan_ns = 0;
+  percentage = best_offload(costs, column_work(cpu_counts, probe.width),
+                            column_work(cl_counts, probe.width), scale,
+                            &makespan_ns);
+  cache.store(raw_device_id(dev), problem, percentage);
+  cerr << "calibration, miss, " << percentage << ", "
+       << static_cast<uint64_t>(makespan_ns / 1000000) << endl
+       << "costs, " << costs.cpu_ns_per_iteration << ", "
+       << costs.cl_overhead_ns << ", " << costs.cl_ns_per_iteration << endl;
+  return percentage;
+}
+
+// width and height of the probe renders used for verification
+constexpr uint32_t verify_size = 1024;
+
+// renders a probe of `view` with brute force and with interior skipping on
+// the CPU and on the OpenCL device, prints the number of differing pixels
+void verify_interior(actor_system& system, const config& cfg,
+                     const mandelbrot_view& view, mandelbrot_kernel kernel) {
+  auto probe = view;
+  probe.width = min(view.width, verify_size);
+  probe.height = min(view.height, verify_size);
+  auto pixels = size_t{probe.width} * probe.height;
+  auto mismatches = [](const vector<int>& xs, const vector<int>& ys) {
+    size_t result = 0;
+    for (size_t i = 0; i < xs.size(); ++i)
+      if (i >= ys.size() || xs[i] != ys[i])
+        ++result;
+    return result;
+  };
+  vector<int> brute_force(pixels);
+  vector<int> skipped(pixels);
+  mandelbrot_rows(probe, 0, probe.height, brute_force.data(), kernel, false);
+  mandelbrot_rows(probe, 0, probe.height, skipped.data(), kernel, true);
+  cerr << "verify, cpu, " << mismatches(brute_force, skipped) << ", "
+       << pixels << endl;
+  auto& mngr = system.opencl_manager();
+  auto dev = find_device(mngr, cfg.device_name);
+  program_build_info build_info;
+  auto prog = create_cached_program(dev, kernel_source, "", cfg.program_cache,
+                                    &build_info);
+  print_build_info("program", build_info);
+  scoped_actor self{system};
+  auto render = [&](const char* kernel_name) {
+    auto worker = mngr.spawn(prog, kernel_name,
+                             nd_range{dim_vec{probe.width, probe.height}},
+                             in<float_type>{}, out<int>{});
+    vector<int> result;
+    self->send(worker, make_cljob(probe));
+    self->receive(
+      [&](vector<int>& counts) {
+        result = move(counts);
+      }
+    );
+    anon_send_exit(worker, exit_reason::user_shutdown);
+    return result;
+  };
+  brute_force = render("mandelbrot");
+  skipped = render("mandelbrot_interior");
+  cerr << "verify, opencl, " << mismatches(brute_force, skipped) << ", "
+       << pixels << endl;
+}
 
-  auto cpu_width  = get_bottom(cfg.width, on_cpu);
-  auto cpu_height = cfg.height;
-  auto cpu_min_re = min_re;
-  auto cpu_max_re = get_cut(min_re, max_re, on_cpu);
-  auto cpu_min_im = min_im;
-  auto cpu_max_im = max_im;
+// keeps the fastest of a few renders of `view` with counts of type `T` and
+// returns its time in ms, the first render also warms up the device
+template<typename T>
+double time_counts(scoped_actor& self, const opencl::program_ptr& prog,
+                   const char* kernel_name, const nd_range& ndr,
+                   const mandelbrot_view& view, vector<T>& counts) {
+  auto& mngr = self->system().opencl_manager();
+  auto worker = mngr.spawn(prog, kernel_name, ndr, in<float_type>{},
+                           out<T>{});
+  auto best = numeric_limits<double>::max();
+  for (int i = 0; i < 3; ++i) {
+    auto start = chrono::steady_clock::now();
+    self->send(worker, make_cljob(view));
+    self->receive(
+      [&](vector<T>& result) {
+        counts = move(result);
+      }
+    );
+    best = min(best, chrono::duration<double, milli>(
+      chrono::steady_clock::now() - start
+    ).count());
+  }
+  anon_send_exit(worker, exit_reason::user_shutdown);
+  return best;
+}
+
+// renders `view` with the compact count format of type `T` and prints its
+// transfer, render and decode time next to the savings over `reference`,
+// the int32 counts that took `reference_ms`
+template<typename T>
+void report_counts(scoped_actor& self, const config& cfg,
+                   const opencl::device_ptr& dev, const nd_range& ndr,
+                   const mandelbrot_view& view, render_kernels kernels,
+                   count_format format, const vector<int>& reference,
+                   double reference_ms) {
+  program_build_info build_info;
+  auto prog = create_cached_program(dev, kernel_source,
+                                    count_format_options(format),
+                                    cfg.program_cache, &build_info);
+  print_build_info(string{"program "} + to_string(format), build_info);
+  vector<T> counts;
+  auto ms = time_counts(self, prog, kernels.cl_name(), ndr, view, counts);
+  vector<int> decoded(counts.size());
+  auto start = chrono::steady_clock::now();
+  decode_counts(counts.data(), counts.size(), view.iterations,
+                decoded.data());
+  auto decode_ms = chrono::duration<double, milli>(
+    chrono::steady_clock::now() - start
+  ).count();
+  // the device has to encode exactly like the host
+  vector<T> expected(reference.size());
+  encode_counts(reference.data(), reference.size(), view.iterations,
+                expected.data());
+  size_t encoding = 0;
+  size_t mismatches = 0;
+  for (size_t i = 0; i < reference.size(); ++i) {
+    if (i >= counts.size() || counts[i] != expected[i])
+      ++encoding;
+    if (i >= decoded.size() || decoded[i] != reference[i])
+      ++mismatches;
+  }
+  auto bytes = reference.size() * sizeof(T);
+  cout << "counts, " << to_string(format) << ", " << bytes << ", " << ms
+       << ", " << decode_ms << ", "
+       << reference.size() * sizeof(int) - bytes << ", "
+       << reference_ms - ms - decode_ms << ", "
+       << exact_counts(format, view.iterations) << ", " << mismatches
+       << ", " << encoding << endl;
+}
+
+// renders `view` on the OpenCL device once per count format
+void compare_count_formats(actor_system& system, const config& cfg,
+                           const mandelbrot_view& view,
+                           render_kernels kernels) {
+  auto& mngr = system.opencl_manager();
+  auto dev = find_device(mngr, cfg.device_name);
+  auto ndr = mandelbrot_range(dev, kernels.cl_name(), cfg.tune,
+                              cfg.tuning_cache, view);
+  scoped_actor self{system};
+  program_build_info build_info;
+  auto prog = create_cached_program(dev, kernel_source, "",
+                                    cfg.program_cache, &build_info);
+  print_build_info("program int32", build_info);
+  vector<int> reference;
+  auto ms = time_counts(self, prog, kernels.cl_name(), ndr, view,
+                        reference);
+  cout << "counts, int32, " << reference.size() * sizeof(int) << ", " << ms
+       << ", 0, 0, 0, 1, 0, 0" << endl;
+  report_counts<uint16_t>(self, cfg, dev, ndr, view, kernels,
+                          count_format::uint16, reference, ms);
+  report_counts<uint8_t>(self, cfg, dev, ndr, view, kernels,
+                         count_format::uint8, reference, ms);
+}
+
+// requests of each variant of compare-args excluded from the results
+constexpr size_t args_warmup = 10;
+
+// renders a small frame of `view` one request at a time with each way to
+// pass the configuration, prints the latency of a request in us and the
+// pixels that differ from the buffer variant
+void compare_kernel_args(actor_system& system, const config& cfg,
+                         const mandelbrot_view& view,
+                         render_kernels kernels) {
+  auto& mngr = system.opencl_manager();
+  auto dev = find_device(mngr, cfg.device_name);
+  program_build_info build_info;
+  auto prog = create_cached_program(dev, kernel_source, "",
+                                    cfg.program_cache, &build_info);
+  print_build_info("program", build_info);
+  auto frame = view;
+  frame.width = min(view.width, max(cfg.args_size, uint32_t{2}));
+  frame.height = min(view.height, max(cfg.args_size, uint32_t{2}));
+  auto ndr = nd_range{dim_vec{frame.width, frame.height}};
+  auto clargs = make_clargs(frame);
+  scoped_actor self{system};
+  vector<int> reference;
+  cout << "args, mean, p50, p99, max, mismatches" << endl;
+  for (auto args : {kernel_args::buffer, kernel_args::scalars,
+                    kernel_args::structure}) {
+    auto worker = spawn_image_kernel<int>(mngr, prog, kernels.cl_name(),
+                                          args, ndr);
+    vector<double> latencies;
+    vector<int> counts;
+    for (size_t i = 0; i < args_warmup + cfg.args_requests; ++i) {
+      auto start = chrono::steady_clock::now();
+      self->send(worker, clargs);
+      self->receive(
+        [&](vector<int>& result) {
+          counts = move(result);
+        }
+      );
+      if (i >= args_warmup)
+        latencies.push_back(chrono::duration<double, micro>(
+          chrono::steady_clock::now() - start
+        ).count());
+    }
+    anon_send_exit(worker, exit_reason::user_shutdown);
+    if (args == kernel_args::buffer)
+      reference = counts;
+    size_t mismatches = 0;
+    for (size_t i = 0; i < reference.size(); ++i)
+      if (i >= counts.size() || counts[i] != reference[i])
+        ++mismatches;
+    auto s = summarize(latencies);
+    cout << to_string(args) << ", " << s.mean << ", " << s.p50 << ", "
+         << s.p99 << ", " << s.max << ", " << mismatches << endl;
+  }
+}
+
+// splits the image into row bands that CPU and OpenCL workers pull until
+// none are left, prints the resulting split like the static mode. With an
+// output file, finished bands go to `sink` and no image is kept in memory.
+// OpenCL workers receive counts of type `T`.
+template<typename T>
+void run_dynamic(actor_system& system, const config& cfg,
+                 const mandelbrot_view& view, render_kernels kernels,
+                 count_format format, kernel_args args,
+                 image_sink* sink) {
+  vector<int> image(sink ? 0 : size_t{view.width} * view.height);
+  band_queue queue{view.height};
+  band_stats cpu;
+  band_stats cl;
+  auto cpu_band = max(cfg.cpu_band, uint32_t{1});
+  // a band of the kernel needs two rows to compute its pixel spacing
+  auto cl_band = max(cfg.cl_band, uint32_t{2});
+  auto cpu_workers = cfg.cpu_workers > 0 ? cfg.cpu_workers
+                                         : cfg.scheduler_max_threads;
+  vector<actor> cl_actors;
+  if (cfg.cl_workers > 0) {
+    auto& mngr = system.opencl_manager();
+    auto dev = find_device(mngr, cfg.device_name);
+    program_build_info build_info;
+    auto prog = create_cached_program(dev, kernel_source,
+                                      count_format_options(format),
+                                      cfg.program_cache, &build_info);
+    print_build_info("program", build_info);
+    auto ndr = mandelbrot_range(dev, kernels.cl_name(), cfg.tune,
+                                cfg.tuning_cache, view.band(0, cl_band));
+    for (size_t i = 0; i < cfg.cl_workers; ++i)
+      cl_actors.push_back(spawn_image_kernel<T>(mngr, prog, kernels.cl_name(),
+                                                args, ndr));
+  }
+  cpu.active = cpu_workers;
+  cl.active = cl_actors.size();
+  auto start = chrono::system_clock::now();
+  for (auto& worker : cl_actors)
+    system.spawn(cl_band_worker<T>, worker, &queue, &cl, view, cl_band,
+                 image.data(), sink);
+  for (size_t i = 0; i < cpu_workers; ++i)
+    system.spawn(cpu_band_worker, &queue, &cpu, view, cpu_band, kernels,
+                 image.data(), sink);
+  cl_actors.clear();
+  system.await_all_actors_done();
+  total_end = chrono::system_clock::now();
+  auto ms = [&](chrono::system_clock::time_point end) {
+    return chrono::duration_cast<chrono::milliseconds>(end - start).count();
+  };
+  with_opencl = view.height > 0 ? cl.rows * 100 / view.height : 0;
+  cout << with_opencl
+       << ", " << chrono::duration_cast<chrono::milliseconds>(
+                    total_end - total_start
+                  ).count()
+       << ", " << (cpu.bands > 0 ? ms(cpu.end) : 0)
+       << ", " << (cl.bands > 0 ? ms(cl.end) : 0)
+       << endl;
+  // every band is transferred completely, also the last one
+  auto transferred = uint64_t{cl.bands} * cl_band * view.width;
+  cerr << "bands, cpu, " << cpu.bands << ", " << cpu.rows << endl
+       << "bands, opencl, " << cl.bands << ", " << cl.rows << endl
+       << "transfer, " << to_string(format) << ", "
+       << transferred * sizeof(T) << ", "
+       << transferred * (sizeof(int) - sizeof(T)) << endl;
+  if (!sink)
+    return;
+  // throughput of a worker copying into the mapping and of the final write
+  // back of the pages that are still dirty
+  auto flush_ns = sink->flush();
+  auto mb_per_s = [](uint64_t bytes, uint64_t ns) {
+    return ns > 0 ? bytes * 1000.0 / ns : 0.0;
+  };
+  cerr << "sink, " << to_string(sink->format()) << ", "
+       << sink->bytes_written() << ", "
+       << mb_per_s(sink->bytes_written(), sink->write_ns()) << ", "
+       << mb_per_s(sink->file_bytes(), flush_ns) << ", "
+       << peak_resident_bytes() << endl;
+}
+
+// renders `view` once completely and once with Mariani-Silver subdivision,
+// either with CPU tasks or with batched OpenCL launches, and compares both
+void run_mariani_silver(actor_system& system, const config& cfg,
+                        const mandelbrot_view& view, render_kernels kernels) {
+  auto pixels = size_t{view.width} * view.height;
+  vector<int> full(pixels);
+  vector<int> image(pixels);
+  scoped_actor self{system};
+  auto ms_since = [](chrono::steady_clock::time_point start) {
+    return chrono::duration_cast<chrono::milliseconds>(
+      chrono::steady_clock::now() - start
+    ).count();
+  };
+  mariani_silver ms{view, image.data(), cfg.ms_min_size};
+  auto root = ms.root();
+  vector<ms_line> lines;
+  long long full_ms = 0;
+  long long ms_ms = 0;
+  size_t launches = 0;
+  if (cfg.ms_opencl) {
+    auto& mngr = system.opencl_manager();
+    auto dev = find_device(mngr, cfg.device_name);
+    program_build_info build_info;
+    auto prog = create_cached_program(dev, kernel_source, "",
+                                      cfg.program_cache, &build_info);
+    print_build_info("program", build_info);
+    auto ndr = mandelbrot_range(dev, kernels.cl_name(), cfg.tune,
+                                cfg.tuning_cache, view);
+    auto start = chrono::steady_clock::now();
+    auto worker = mngr.spawn(prog, kernels.cl_name(), ndr,
+                             in<float_type>{}, out<int>{});
+    self->send(worker, make_cljob(view));
+    self->receive(
+      [&](vector<int>& result) {
+        full = move(result);
+      }
+    );
+    full_ms = ms_since(start);
+    anon_send_exit(worker, exit_reason::user_shutdown);
+    // all lines of a level go to the device in a single launch
+    auto evaluate = [&](const vector<ms_line>& xs) {
+      auto n = mariani_silver::pixels(xs);
+      if (n == 0)
+        return;
+      vector<int> points;
+      points.reserve(2 * n);
+      for (auto& l : xs) {
+        for (auto i = l.first; i < l.last; ++i) {
+          points.push_back(static_cast<int>(l.vertical ? l.fixed : i));
+          points.push_back(static_cast<int>(l.vertical ? i : l.fixed));
+        }
+      }
+      auto range = nd_range{dim_vec{static_cast<size_t>(n)}};
+      auto points_worker = mngr.spawn(prog, "mandelbrot_points", range,
+                                      in<float_type>{}, in<int>{},
+                                      out<int>{});
+      self->send(points_worker, make_cljob(view), move(points));
+      self->receive(
+        [&](const vector<int>& counts) {
+          ms.scatter(xs, counts.data());
+        }
+      );
+      anon_send_exit(points_worker, exit_reason::user_shutdown);
+      ++launches;
+    };
+    start = chrono::steady_clock::now();
+    ms.border(root, lines);
+    evaluate(lines);
+    vector<ms_tile> level{root};
+    vector<ms_tile> next;
+    while (!level.empty()) {
+      lines.clear();
+      next.clear();
+      for (auto& t : level)
+        ms.split(t, lines, next);
+      evaluate(lines);
+      level.swap(next);
+    }
+    ms_ms = ms_since(start);
+  } else {
+    auto workers = cfg.cpu_workers > 0 ? cfg.cpu_workers
+                                       : cfg.scheduler_max_threads;
+    auto listener = actor_cast<actor>(self);
+    band_queue queue{view.height};
+    tile_stats stats;
+    stats.rows_left = view.height;
+    auto start = chrono::steady_clock::now();
+    auto max_rows = static_cast<uint32_t>(view.height / (4 * workers));
+    for (size_t i = 0; i < workers; ++i)
+      self->monitor(system.spawn(cpu_tile_worker, &queue, &stats, view,
+                                 max_rows, cfg.tile_us, kernels, full.data(),
+                                 listener));
+    self->receive([](ack_atom) { /* nop */ });
+    full_ms = ms_since(start);
+    // the workers poll the queue once more before they quit, the queue and
+    // the stats must outlive them
+    size_t down = 0;
+    self->receive_for(down, workers)([](const down_msg&) { /* nop */ });
+    start = chrono::steady_clock::now();
+    ms.border(root, lines);
+    ms.compute(lines, kernels.cpu, kernels.skip_interior);
+    atomic<size_t> pending{1};
+    system.spawn(ms_task, &ms, kernels, &pending, listener, root);
+    self->receive([](ack_atom) { /* nop */ });
+    ms_ms = ms_since(start);
+  }
+  size_t mismatches = 0;
+  for (size_t i = 0; i < pixels; ++i)
+    if (full[i] != image[i])
+      ++mismatches;
+  cout << "mariani-silver, " << (cfg.ms_opencl ? "opencl" : "cpu") << ", "
+       << ms.iterated() << ", " << pixels << ", " << full_ms << ", "
+       << ms_ms << ", "
+       << (ms_ms > 0 ? static_cast<double>(full_ms) / ms_ms : 0.0) << ", "
+       << mismatches << endl;
+  if (cfg.ms_opencl)
+    cerr << "launches, " << launches << endl;
+}
+
+// renders `view` with the static split of `with_opencl`, the OpenCL part
+// runs on a single actor and the CPU part on a tile queue or on one actor
+// per row, sets the global timestamps and times of both sides
+void run_static(actor_system& system, const config& cfg,
+                const mandelbrot_view& view, render_kernels kernels,
+                count_format counts, kernel_args args, bool adaptive) {
+  auto on_cpu = static_cast<uint32_t>(100 - with_opencl);
+  auto cpu_width  = get_bottom(view.width, on_cpu);
+  auto cpu_height = view.height;
+  auto cpu_min_re = view.min_re;
+  auto cpu_max_re = get_cut(view.min_re, view.max_re, on_cpu);
+  auto cpu_min_im = view.min_im;
+  auto cpu_max_im = view.max_im;
   DEBUG("[CPU] width: " << cpu_width
         << "(" << cpu_min_re << " to " << cpu_max_re << ")");
 
-  auto opencl_width  = get_top(cfg.width, on_cpu);
-  auto opencl_height = cfg.height;
-  auto opencl_min_re = get_cut(min_re, max_re, on_cpu);
-  auto opencl_max_re = max_re;
-  auto opencl_min_im = min_im;
-  auto opencl_max_im = max_im;
+  auto opencl_width  = get_top(view.width, on_cpu);
+  auto opencl_height = view.height;
+  auto opencl_min_re = get_cut(view.min_re, view.max_re, on_cpu);
+  auto opencl_max_re = view.max_re;
+  auto opencl_min_im = view.min_im;
+  auto opencl_max_im = view.max_im;
   DEBUG("[OpenCL] width: " << opencl_width
         << "(" << opencl_min_re << " to " << opencl_max_re << ")");
 
   if (opencl_width > 0) {
     // trigger calculation with OpenCL
-    system.spawn(mandel_cl, cfg.device_name, iterations, opencl_width, opencl_height,
+    auto fn = &mandel_cl<int>;
+    if (counts == count_format::uint16)
+      fn = &mandel_cl<uint16_t>;
+    else if (counts == count_format::uint8)
+      fn = &mandel_cl<uint8_t>;
+    system.spawn(fn, cfg.device_name, cfg.tune, cfg.tuning_cache,
+                 cfg.program_cache, string{kernels.cl_name()}, counts, args,
+                 view.iterations, opencl_width, opencl_height,
                  opencl_min_re, opencl_max_re, opencl_min_im, opencl_max_im);
   }
 
+  // workers may still poll the queue after the last tile, hence the queue
+  // and the stats have to live until all actors are done
+  band_queue queue{cpu_height};
+  tile_stats stats;
+  stats.rows_left = cpu_height;
   cpu_start = chrono::system_clock::now();
   if (cpu_width > 0) {
     scoped_actor cnt{system};
     // trigger calculation on the CPU
     vector<int> image(cpu_width * cpu_height);
-    auto re_factor = (cpu_max_re - cpu_min_re) / (cpu_width - 1);
-    auto im_factor = (cpu_max_im - cpu_min_im) / (cpu_height - 1);
+    mandelbrot_view cpu_view{view.iterations,
+                             cpu_width, cpu_height,
+                             cpu_min_re, cpu_max_re, cpu_min_im, cpu_max_im};
     int* indirection = image.data();
-    for (uint32_t im = 0; im < cpu_height; ++im) {
-      system.spawn([&cnt, indirection, cpu_width, cpu_min_re, cpu_max_re,
-                    cpu_min_im, cpu_max_im, re_factor, im_factor, im,
-                    iterations] (event_based_actor* self) {
-        for (uint32_t re = 0; re < cpu_width; ++re) {
-          auto z_re = cpu_min_re + re * re_factor;
-          auto z_im = cpu_max_im - im * im_factor;
-          auto const_re = z_re;
-          auto const_im = z_im;
-          uint32_t cnt = 0;
-          float_type cond = 0;
-          do {
-            auto tmp_re = z_re;
-            auto tmp_im = z_im;
-            z_re = (tmp_re * tmp_re - tmp_im * tmp_im) + const_re;
-            z_im = (2 * tmp_re * tmp_im) + const_im;
-            cond = z_re * z_re + z_im * z_im;
-            ++cnt;
-          } while (cnt < iterations && cond <= 4.0f);
-          indirection[re + im * cpu_width] = cnt;
-        }
-        self->send(cnt, ack_atom::value);
-      });
+    auto workers = cfg.cpu_workers > 0 ? cfg.cpu_workers
+                                       : cfg.scheduler_max_threads;
+    size_t tasks = 0;
+    auto spawn_start = chrono::steady_clock::now();
+    if (adaptive) {
+      // a few tiles per worker at most keep the tail balanced
+      auto max_rows = static_cast<uint32_t>(cpu_height / (4 * workers));
+      auto listener = actor_cast<actor>(cnt);
+      for (size_t i = 0; i < workers; ++i)
+        system.spawn(cpu_tile_worker, &queue, &stats, cpu_view, max_rows,
+                     cfg.tile_us, kernels, indirection, listener);
+      tasks = workers;
+    } else {
+      for (uint32_t im = 0; im < cpu_height; ++im) {
+        system.spawn([&cnt, &stats, indirection, cpu_view, kernels, im]
+                     (event_based_actor* self) {
+          auto start = chrono::steady_clock::now();
+          mandelbrot_rows(cpu_view, im, im + 1,
+                          indirection + im * cpu_view.width, kernels.cpu,
+                          kernels.skip_interior);
+          stats.complete(1, start);
+          self->send(cnt, ack_atom::value);
+        });
+      }
+      tasks = cpu_height;
+    }
+    auto spawn_end = chrono::steady_clock::now();
+    if (adaptive) {
+      cnt->receive([](ack_atom) { /* nop */ });
+    } else {
+      unsigned i = 0;
+      cnt->receive_for(i, cpu_height)( [](ack_atom) { /* nop */ } );
     }
-    unsigned i = 0;
-    cnt->receive_for(i, cpu_height)( [](ack_atom) { /* nop */ } );
     // await_all_actors_done();
     cpu_end = chrono::system_clock::now();
     DEBUG("Mandelbrot on CPU calculated");
+    auto us = [](chrono::steady_clock::time_point from,
+                 chrono::steady_clock::time_point to) {
+      return static_cast<long long>(
+        chrono::duration_cast<chrono::microseconds>(to - from).count()
+      );
+    };
+    // compute is the runtime of the kernel spread across the scheduler
+    // threads, anything else on the CPU side is spawning and messaging
+    auto wall_us = us(spawn_start, chrono::steady_clock::now());
+    auto spawn_us = us(spawn_start, spawn_end);
+    auto compute_us = static_cast<long long>(
+      stats.compute_ns / 1000
+      / max(min(tasks, cfg.scheduler_max_threads), size_t{1})
+    );
+    cerr << "cpu tasks, " << cfg.cpu_tasks << ", " << tasks << ", "
+         << stats.tiles << ", " << spawn_us << ", " << compute_us << ", "
+         << max(wall_us - spawn_us - compute_us, 0ll) << endl;
   }
 
   system.await_all_actors_done();
@@ -245,7 +1412,140 @@ void caf_main(actor_system& system, const config& cfg) {
     time_opencl = chrono::duration_cast<chrono::milliseconds>(
       opencl_end - opencl_start
     ).count();
+    auto transferred = uint64_t{opencl_width} * opencl_height;
+    cerr << "transfer, " << to_string(counts) << ", "
+         << transferred * count_bytes(counts) << ", "
+         << transferred * (sizeof(int) - count_bytes(counts)) << endl;
   }
+}
+
+void caf_main(actor_system& system, const config& cfg) {
+  total_start = chrono::system_clock::now();
+  with_opencl = cfg.offloaded != unset_offload ? cfg.offloaded : 0;
+  auto iterations = cfg.iterations;
+  auto min_re  = default_min_real;
+  auto max_re  = default_max_real;
+  auto min_im  = default_min_imag;
+  auto max_im  = default_max_imag;
+
+  auto scale = [&](const float_type ratio) {
+    float_type abs_re = fabs(max_re + (-1 * min_re)) / 2;
+    float_type abs_im = fabs(max_im + (-1 * min_im)) / 2;
+    float_type mid_re = min_re + abs_re;
+    float_type mid_im = min_im + abs_im;
+    auto dist = abs_re * ratio;
+    min_re = mid_re - dist;
+    max_re = mid_re + dist;
+    min_im = mid_im - dist;
+    max_im = mid_im + dist;
+  };
+  scale(default_scaling);
+
+  mandelbrot_kernel kernel;
+  if (!parse_mandelbrot_kernel(cfg.cpu_kernel, kernel)) {
+    cerr << "Unknown kernel '" << cfg.cpu_kernel << "'." << endl;
+    return;
+  }
+  auto adaptive = cfg.cpu_tasks == "adaptive";
+  if (!adaptive && cfg.cpu_tasks != "rows") {
+    cerr << "Unknown decomposition '" << cfg.cpu_tasks << "'." << endl;
+    return;
+  }
+  image_format output_format;
+  if (!parse_image_format(cfg.output_format, output_format)) {
+    cerr << "Unknown output format '" << cfg.output_format << "'." << endl;
+    return;
+  }
+  count_format counts;
+  if (!parse_count_format(cfg.counts, counts)) {
+    cerr << "Unknown count format '" << cfg.counts << "'." << endl;
+    return;
+  }
+  kernel_args args;
+  if (!parse_kernel_args(cfg.cl_args, args)) {
+    cerr << "Unknown argument passing '" << cfg.cl_args << "'." << endl;
+    return;
+  }
+  if (!cfg.output.empty() && !cfg.dynamic) {
+    cerr << "Writing to an output file requires dynamic mode." << endl;
+    return;
+  }
+  if (cfg.compare_static && !cfg.dynamic) {
+    cerr << "Comparing with a static split requires dynamic mode." << endl;
+    return;
+  }
+  if (cfg.calibrate && cfg.dynamic && !cfg.compare_static) {
+    cerr << "Calibrating in dynamic mode requires compare-static." << endl;
+    return;
+  }
+  cerr << "cpu kernel, " << to_string(kernel) << ", "
+       << (kernel == mandelbrot_kernel::simd ? mandelbrot_isa() : "scalar")
+       << endl;
+  render_kernels kernels{kernel, cfg.skip_interior};
+  mandelbrot_view view{static_cast<uint32_t>(iterations),
+                       cfg.width, cfg.height,
+                       min_re, max_re, min_im, max_im};
+
+  if (cfg.verify) {
+    verify_interior(system, cfg, view, kernel);
+    return;
+  }
+
+  if (cfg.compare_counts) {
+    compare_count_formats(system, cfg, view, kernels);
+    return;
+  }
+
+  if (cfg.compare_args) {
+    compare_kernel_args(system, cfg, view, kernels);
+    return;
+  }
+
+  if (cfg.mariani_silver) {
+    run_mariani_silver(system, cfg, view, kernels);
+    return;
+  }
+
+  if (cfg.dynamic) {
+    unique_ptr<image_sink> sink;
+    if (!cfg.output.empty())
+      sink.reset(new image_sink(cfg.output, output_format, view.width,
+                                view.height, view.iterations));
+    auto run = &run_dynamic<int>;
+    if (counts == count_format::uint16)
+      run = &run_dynamic<uint16_t>;
+    else if (counts == count_format::uint8)
+      run = &run_dynamic<uint8_t>;
+    auto dynamic_start = chrono::system_clock::now();
+    run(system, cfg, view, kernels, counts, args, sink.get());
+    if (!cfg.compare_static)
+      return;
+    auto since = [](chrono::system_clock::time_point start) {
+      return chrono::duration_cast<chrono::milliseconds>(
+        total_end - start
+      ).count();
+    };
+    auto dynamic_ms = since(dynamic_start);
+    // the static reference renders into memory, also with an output file,
+    // and uses the calibrated split unless the user picked one
+    if (cfg.calibrate || cfg.offloaded == unset_offload)
+      with_opencl = calibrate_offload(system, cfg, view, kernels);
+    else
+      with_opencl = cfg.offloaded;
+    auto static_start = chrono::system_clock::now();
+    run_static(system, cfg, view, kernels, counts, args, adaptive);
+    auto static_ms = since(static_start);
+    cerr << "static, " << with_opencl << ", " << static_ms << ", "
+         << dynamic_ms << ", "
+         << (static_ms > 0 ? static_cast<double>(dynamic_ms) / static_ms
+                           : 0.0)
+         << endl;
+    return;
+  }
+
+  if (cfg.calibrate)
+    with_opencl = calibrate_offload(system, cfg, view, kernels);
+  run_static(system, cfg, view, kernels, counts, args, adaptive);
   auto time_total = chrono::duration_cast<chrono::milliseconds>(
     total_end - total_start
   ).count();
@@ -0,0 +1,74 @@
+#include "include/buffer_pool.hpp"
+
+using namespace std;
+
+namespace {
+
+size_t size_class(size_t bytes) {
+  size_t result = 1;
+  while (result < bytes)
+    result <<= 1;
+  return result;
+}
+
+} // namespace <anonymous>
+
+buffer_pool::buffer_pool(context_ptr context, bool enabled)
+  : context_(move(context)),
+    enabled_(enabled) {
+  // nop
+}
+
+mem_ptr buffer_pool::acquire(cl_mem_flags flags, size_t bytes) {
+  auto capacity = enabled_ ? size_class(bytes) : bytes;
+  {
+    lock_guard<mutex> guard{mtx_};
+    stats_.bytes_outstanding += capacity;
+    stats_.peak_bytes_outstanding = max(stats_.peak_bytes_outstanding,
+                                        stats_.bytes_outstanding);
+    auto i = free_.find(key{flags, capacity});
+    if (i != free_.end() && !i->second.empty()) {
+      auto buf = move(i->second.back());
+      i->second.pop_back();
+      stats_.bytes_pooled -= capacity;
+      ++stats_.hits;
+      return buf;
+    }
+    ++stats_.misses;
+  }
+  cl_int err = CL_SUCCESS;
+  mem_ptr buf;
+  buf.adopt(clCreateBuffer(context_.get(), flags, capacity, nullptr, &err));
+  check_cl_error(err, "clCreateBuffer");
+  return buf;
+}
+
+void buffer_pool::release(mem_ptr buf) {
+  if (!buf)
+    return;
+  cl_mem_flags flags = 0;
+  size_t capacity = 0;
+  auto err = clGetMemObjectInfo(buf.get(), CL_MEM_FLAGS, sizeof(cl_mem_flags),
+                                &flags, nullptr);
+  check_cl_error(err, "clGetMemObjectInfo");
+  err = clGetMemObjectInfo(buf.get(), CL_MEM_SIZE, sizeof(size_t), &capacity,
+                           nullptr);
+  check_cl_error(err, "clGetMemObjectInfo");
+  lock_guard<mutex> guard{mtx_};
+  stats_.bytes_outstanding -= capacity;
+  if (enabled_) {
+    free_[key{flags, capacity}].push_back(move(buf));
+    stats_.bytes_pooled += capacity;
+  }
+}
+
+void buffer_pool::clear() {
+  lock_guard<mutex> guard{mtx_};
+  free_.clear();
+  stats_.bytes_pooled = 0;
+}
+
+buffer_pool::statistics buffer_pool::stats() const {
+  lock_guard<mutex> guard{mtx_};
+  return stats_;
+}
@@ -1,3 +1,4 @@
+#include <cstring>
 #include <numeric>
 #include <iomanip>
 #include <iterator>
@@ -8,115 +9,324 @@
 
 using namespace std;
 
+namespace {
+
+command_times query_times(cl_event event) {
+  command_times result{0, 0, 0, 0};
+  if (!event)
+    return result;
+  cl_profiling_info params[] = {CL_PROFILING_COMMAND_QUEUED,
+                                CL_PROFILING_COMMAND_SUBMIT,
+                                CL_PROFILING_COMMAND_START,
+                                CL_PROFILING_COMMAND_END};
+  cl_ulong* fields[] = {&result.queued, &result.submit, &result.start,
+                        &result.end};
+  for (size_t i = 0; i < 4; ++i) {
+    auto err = clGetEventProfilingInfo(event, params[i], sizeof(cl_ulong),
+                                       fields[i], nullptr);
+    check_cl_error(err, "clGetEventProfilingInfo");
+  }
+  return result;
+}
+
+mem_ptr create_buffer(cl_context context, cl_mem_flags flags, size_t bytes,
+                      void* host_ptr) {
+  cl_int err = CL_SUCCESS;
+  mem_ptr result;
+  result.adopt(clCreateBuffer(context, flags, bytes, host_ptr, &err));
+  check_cl_error(err, "clCreateBuffer");
+  return result;
+}
+
+} // namespace <anonymous>
+
+bool parse_transfer_mode(const string& str, transfer_mode& mode) {
+  if (str == "pageable")
+    mode = transfer_mode::pageable;
+  else if (str == "pinned")
+    mode = transfer_mode::pinned;
+  else if (str == "zero-copy")
+    mode = transfer_mode::zero_copy;
+  else
+    return false;
+  return true;
+}
+
+string to_string(transfer_mode mode) {
+  switch (mode) {
+    case transfer_mode::pageable:
+      return "pageable";
+    case transfer_mode::pinned:
+      return "pinned";
+    case transfer_mode::zero_copy:
+      return "zero-copy";
+  }
+  return "?";
+}
+
 cmd::cmd(size_t size, kernel_ptr kernel, context_ptr context,
-         command_queue_ptr queue, size_t iterations)
+         vector<command_queue_ptr> queues, size_t iterations,
+         vector<size_t> global_dimensions, vector<size_t> local_dimensions,
+         buffer_pool& pool, transfer_mode mode)
   : size_(size),
+    done_(false),
     kernel_(kernel),
     context_(context),
-    queue_(queue),
+    pool_(pool),
+    mode_(mode),
+    // the baseline refills its input on every pass, other runs only once
+    refill_(!pool.enabled() && queues.size() == 1
+            && mode == transfer_mode::pageable),
     max_iterations_(iterations),
+    next_iteration_(0),
     current_iterations_(0),
-//    matrix_1_(size * size),
-//    matrix_2_(size * size),
-//    result_(size * size),
-    dimensions_({size, size}) {
-
+    dimensions_(move(global_dimensions)),
+    local_dimensions_(move(local_dimensions)),
+    profiling_(false) {
+  slots_.resize(queues.size());
+  for (size_t i = 0; i < queues.size(); ++i) {
+    auto& s = slots_[i];
+    s.parent = this;
+    s.queue = move(queues[i]);
+    s.write_events[0] = nullptr;
+    s.write_events[1] = nullptr;
+    s.kernel_event = nullptr;
+    s.read_event = nullptr;
+    s.marker = nullptr;
+    for (auto& ptr : s.staged)
+      ptr = nullptr;
+    s.mapped_out = nullptr;
+  }
 }
 
 cmd::~cmd() {
-//  clReleaseMemObject(buf_in_1_);
-//  clReleaseMemObject(buf_in_2_);
-//  clReleaseMemObject(buf_out_);
-  clReleaseEvent(write_events_[0]);
-  clReleaseEvent(write_events_[1]);
-  clReleaseEvent(kernel_event_);
-  clReleaseEvent(read_event_);
+  for (auto& s : slots_) {
+    release_events(s);
+    for (size_t i = 0; i < 3; ++i)
+      if (s.staged[i])
+        clEnqueueUnmapMemObject(s.queue.get(), s.staging[i].get(),
+                                s.staged[i], 0, nullptr, nullptr);
+    clFinish(s.queue.get());
+  }
 }
 
-void cmd::enqueue() {
-  cl_int err;
+void cmd::fill_input() {
   auto matrix_size = size_ * size_;
-  auto buffer_size = sizeof(float) * matrix_size;
   matrix_1_.resize(matrix_size);
   matrix_2_.resize(matrix_size);
   iota(begin(matrix_1_), end(matrix_1_), 0);
   iota(begin(matrix_2_), end(matrix_2_), 0);
-  result_.resize(matrix_size);
+}
 
-  buf_in_1_ = clCreateBuffer(context_.get(), CL_MEM_READ_ONLY, buffer_size, nullptr, &err);
-  check_cl_error(err, "clCreateBuffer");
-  buf_in_2_ = clCreateBuffer(context_.get(), CL_MEM_READ_ONLY, buffer_size, nullptr, &err);
-  check_cl_error(err, "clCreateBuffer");
-  buf_out_ = clCreateBuffer(context_.get(), CL_MEM_WRITE_ONLY, buffer_size, nullptr, &err);
-  check_cl_error(err, "clCreateBuffer");
+void cmd::prepare(slot& s) {
+  auto matrix_size = size_ * size_;
+  auto buffer_size = sizeof(float) * matrix_size;
+  s.result.resize(matrix_size);
+  switch (mode_) {
+    case transfer_mode::pageable:
+      break;
+    case transfer_mode::pinned: {
+      // allocated by the runtime in page-locked memory and mapped for the
+      // whole run, DMA transfers then skip the driver's staging copy
+      const float* inputs[] = {matrix_1_.data(), matrix_2_.data(), nullptr};
+      for (size_t i = 0; i < 3; ++i) {
+        s.staging[i] = create_buffer(context_.get(),
+                                     CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                                     buffer_size, nullptr);
+        cl_int err = CL_SUCCESS;
+        auto ptr = clEnqueueMapBuffer(s.queue.get(), s.staging[i].get(),
+                                      CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0,
+                                      buffer_size, 0, nullptr, nullptr, &err);
+        check_cl_error(err, "clEnqueueMapBuffer");
+        s.staged[i] = static_cast<float*>(ptr);
+        if (inputs[i])
+          memcpy(s.staged[i], inputs[i], buffer_size);
+      }
+      break;
+    }
+    case transfer_mode::zero_copy:
+      if (!host_in_1_) {
+        host_in_1_ = create_buffer(context_.get(),
+                                   CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+                                   buffer_size, matrix_1_.data());
+        host_in_2_ = create_buffer(context_.get(),
+                                   CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+                                   buffer_size, matrix_2_.data());
+      }
+      s.host_out = create_buffer(context_.get(),
+                                 CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR,
+                                 buffer_size, s.result.data());
+      break;
+  }
+}
+
+void cmd::enqueue() {
+  fill_input();
+  for (auto& s : slots_)
+    prepare(s);
+  if (max_iterations_ == 0) {
+    lock_guard<mutex> guard{mtx_};
+    done_ = true;
+    return;
+  }
+  for (auto& s : slots_)
+    if (next_iteration_++ < max_iterations_)
+      enqueue(s);
+}
+
+void cmd::enqueue(slot& s) {
+  cl_int err;
+  auto matrix_size = size_ * size_;
+  auto buffer_size = sizeof(float) * matrix_size;
+  if (refill_ && current_iterations_ > 0)
+    fill_input();
+  release_events(s);
+
+  cl_mem in_1;
+  cl_mem in_2;
+  cl_mem out;
+  auto queue = s.queue.get();
+  if (mode_ == transfer_mode::zero_copy) {
+    in_1 = host_in_1_.get();
+    in_2 = host_in_2_.get();
+    out = s.host_out.get();
+  } else {
+    s.buf_in_1 = pool_.acquire(CL_MEM_READ_ONLY, buffer_size);
+    s.buf_in_2 = pool_.acquire(CL_MEM_READ_ONLY, buffer_size);
+    s.buf_out = pool_.acquire(CL_MEM_WRITE_ONLY, buffer_size);
+    in_1 = s.buf_in_1.get();
+    in_2 = s.buf_in_2.get();
+    out = s.buf_out.get();
+    auto pinned = mode_ == transfer_mode::pinned;
+    const float* src_1 = pinned ? s.staged[0] : matrix_1_.data();
+    const float* src_2 = pinned ? s.staged[1] : matrix_2_.data();
   
-  err = clEnqueueWriteBuffer(queue_.get(), buf_in_1_, CL_FALSE, 0,
-                             buffer_size, matrix_1_.data(),
-                             0, nullptr, &write_events_[0]);
-  err = clEnqueueWriteBuffer(queue_.get(), buf_in_2_, CL_FALSE, 0,
-                             buffer_size, matrix_2_.data(),
-                             0, nullptr, &write_events_[1]);
+    err = clEnqueueWriteBuffer(queue, in_1, CL_FALSE, 0,
+                               buffer_size, src_1,
+                               0, nullptr, &s.write_events[0]);
+    err = clEnqueueWriteBuffer(queue, in_2, CL_FALSE, 0,
+                               buffer_size, src_2,
+                               0, nullptr, &s.write_events[1]);
 
 #if defined(__APPLE__)
-  err = clEnqueueMarkerWithWaitList(queue_.get(), 2, write_events_, &marker_);
+    err = clEnqueueMarkerWithWaitList(queue, 2, s.write_events, &s.marker);
 #else
-  err = clEnqueueMarker(queue_.get(), &marker_);
+    err = clEnqueueMarker(queue, &s.marker);
 #endif
+  }
 
-  err = clSetKernelArg(kernel_.get(), 0, sizeof(cl_mem), (void*) &buf_in_1_);
-  check_cl_error(err, "clSetKernelArg");
-  err = clSetKernelArg(kernel_.get(), 1, sizeof(cl_mem), (void*) &buf_in_2_);
-  check_cl_error(err, "clSetKernelArg");
-  err = clSetKernelArg(kernel_.get(), 2, sizeof(cl_mem), (void*) &buf_out_);
-  check_cl_error(err, "clSetKernelArg");
-
-  // enqueue kernel
-  err = clEnqueueNDRangeKernel(queue_.get(), kernel_.get(), dimensions_.size(),
-                               nullptr,            // work item offsets
-                               dimensions_.data(), // golbal dimensions
-                               nullptr,            // local dimensions
-                               1, &marker_, &kernel_event_);
-  check_cl_error(err, "clEnqueueNDRangeKernel");
-  err = clEnqueueReadBuffer(queue_.get(), buf_out_, CL_TRUE, 0,
-                            sizeof(float) * result_.size(),
-                            result_.data(), 1, &kernel_event_, &read_event_);
-  check_cl_error(err, "clEnqueueReadBuffer");
-  clFlush(queue_.get());
+  {
+    // arguments are captured by clEnqueueNDRangeKernel, but setting them
+    // concurrently from several completion callbacks is not thread-safe
+    lock_guard<mutex> guard{kernel_mtx_};
+    err = clSetKernelArg(kernel_.get(), 0, sizeof(cl_mem), (void*) &in_1);
+    check_cl_error(err, "clSetKernelArg");
+    err = clSetKernelArg(kernel_.get(), 1, sizeof(cl_mem), (void*) &in_2);
+    check_cl_error(err, "clSetKernelArg");
+    err = clSetKernelArg(kernel_.get(), 2, sizeof(cl_mem), (void*) &out);
+    check_cl_error(err, "clSetKernelArg");
+
+    // enqueue kernel
+    auto local = local_dimensions_.empty() ? nullptr
+                                           : local_dimensions_.data();
+    err = clEnqueueNDRangeKernel(queue, kernel_.get(), dimensions_.size(),
+                                 nullptr,            // work item offsets
+                                 dimensions_.data(), // golbal dimensions
+                                 local,              // local dimensions
+                                 s.marker ? 1 : 0,
+                                 s.marker ? &s.marker : nullptr,
+                                 &s.kernel_event);
+    check_cl_error(err, "clEnqueueNDRangeKernel");
+  }
+  auto blocking = slots_.size() == 1 ? CL_TRUE : CL_FALSE;
+  if (mode_ == transfer_mode::zero_copy) {
+    // mapping synchronizes `result` with the device, a CPU device returns
+    // the host pointer without copying
+    s.mapped_out = clEnqueueMapBuffer(queue, out, blocking, CL_MAP_READ, 0,
+                                      buffer_size, 1, &s.kernel_event,
+                                      &s.read_event, &err);
+    check_cl_error(err, "clEnqueueMapBuffer");
+  } else {
+    auto dst = mode_ == transfer_mode::pinned ? s.staged[2]
+                                              : s.result.data();
+    err = clEnqueueReadBuffer(queue, out, blocking, 0, buffer_size, dst, 1,
+                              &s.kernel_event, &s.read_event);
+    check_cl_error(err, "clEnqueueReadBuffer");
+  }
+  clFlush(queue);
 
   // set callback for event
-  err = clSetEventCallback(read_event_, CL_COMPLETE,
+  err = clSetEventCallback(s.read_event, CL_COMPLETE,
                            [](cl_event, cl_int, void* data) {
-                               auto c = reinterpret_cast<cmd*>(data);
-                               c->make_decision();
+                               auto ptr = reinterpret_cast<slot*>(data);
+                               ptr->parent->make_decision(*ptr);
                            },
-                           this);
+                           &s);
   check_cl_error(err, "clSetEventCallback");
 }
 
 void cmd::wait() {
   unique_lock<mutex> lk(mtx_);
-  cv_.wait(lk);
+  cv_.wait(lk, [&] { return done_; });
 }
 
-void cmd::make_decision() {
-  ++current_iterations_;
+vector<iteration_profile> cmd::profile() {
+  lock_guard<mutex> guard{profile_mtx_};
+  return profile_;
+}
+
+void cmd::release_events(slot& s) {
+  for (auto ev : {s.write_events[0], s.write_events[1], s.kernel_event,
+                  s.read_event, s.marker})
+    if (ev)
+      clReleaseEvent(ev);
+  s.write_events[0] = nullptr;
+  s.write_events[1] = nullptr;
+  s.kernel_event = nullptr;
+  s.read_event = nullptr;
+  s.marker = nullptr;
+}
+
+void cmd::make_decision(slot& s) {
+  auto iterations = ++current_iterations_;
 #ifdef CL_ENABLE_DEBUG
-  if (current_iterations_ >= max_iterations_) {
+  if (iterations >= max_iterations_) {
+    const float* result = s.result.data();
+    if (mode_ == transfer_mode::pinned)
+      result = s.staged[2];
+    else if (mode_ == transfer_mode::zero_copy)
+      result = static_cast<const float*>(s.mapped_out);
     for (size_t column = 0; column < size_; ++column) {
       for (size_t row = 0; row < size_; ++row) {
         cout << std::fixed << setprecision(2) << setw(9)
-             << result_[row + column * size_];
+             << result[row + column * size_];
       }
       cout << endl;
     }
   }
 #endif
-  clReleaseMemObject(buf_in_1_);
-  clReleaseMemObject(buf_in_2_);
-  clReleaseMemObject(buf_out_);
-  if (current_iterations_ >= max_iterations_) {
+  if (profiling_) {
+    iteration_profile p;
+    p.upload[0] = query_times(s.write_events[0]);
+    p.upload[1] = query_times(s.write_events[1]);
+    p.kernel = query_times(s.kernel_event);
+    p.download = query_times(s.read_event);
+    lock_guard<mutex> guard{profile_mtx_};
+    profile_.push_back(p);
+  }
+  if (s.mapped_out) {
+    clEnqueueUnmapMemObject(s.queue.get(), s.host_out.get(), s.mapped_out, 0,
+                            nullptr, nullptr);
+    s.mapped_out = nullptr;
+  }
+  pool_.release(move(s.buf_in_1));
+  pool_.release(move(s.buf_in_2));
+  pool_.release(move(s.buf_out));
+  if (iterations >= max_iterations_) {
+    lock_guard<mutex> guard{mtx_};
+    done_ = true;
     cv_.notify_one();
-  } else {
-    enqueue();
+  } else if (next_iteration_++ < max_iterations_) {
+    enqueue(s);
   }
 }
@@ -0,0 +1,91 @@
+#include <algorithm>
+
+#include "include/count_format.hpp"
+
+using namespace std;
+
+bool parse_count_format(const string& name, count_format& format) {
+  if (name == "int32")
+    format = count_format::int32;
+  else if (name == "uint16")
+    format = count_format::uint16;
+  else if (name == "uint8")
+    format = count_format::uint8;
+  else
+    return false;
+  return true;
+}
+
+const char* to_string(count_format format) {
+  switch (format) {
+    case count_format::uint16:
+      return "uint16";
+    case count_format::uint8:
+      return "uint8";
+    default:
+      return "int32";
+  }
+}
+
+size_t count_bytes(count_format format) {
+  switch (format) {
+    case count_format::uint16:
+      return sizeof(uint16_t);
+    case count_format::uint8:
+      return sizeof(uint8_t);
+    default:
+      return sizeof(int32_t);
+  }
+}
+
+bool exact_counts(count_format format, uint32_t iterations) {
+  switch (format) {
+    case count_format::uint16:
+      return iterations <= 65535;
+    case count_format::uint8:
+      // escaped points need at most `iterations - 1` iterations
+      return iterations <= 128;
+    default:
+      return true;
+  }
+}
+
+const char* count_format_options(count_format format) {
+  switch (format) {
+    case count_format::uint16:
+      return "-DCOUNT_FORMAT=1";
+    case count_format::uint8:
+      return "-DCOUNT_FORMAT=2";
+    default:
+      return "";
+  }
+}
+
+void encode_counts(const int* in, size_t n, uint32_t, uint16_t* out) {
+  for (size_t i = 0; i < n; ++i)
+    out[i] = static_cast<uint16_t>(min(in[i], 65535));
+}
+
+void encode_counts(const int* in, size_t n, uint32_t iterations,
+                   uint8_t* out) {
+  auto limit = static_cast<int>(iterations);
+  for (size_t i = 0; i < n; ++i)
+    out[i] = in[i] < limit ? static_cast<uint8_t>(0x80 | min(in[i], 127))
+                           : uint8_t{0};
+}
+
+void decode_counts(const int* in, size_t n, uint32_t, int* out) {
+  copy(in, in + n, out);
+}
+
+void decode_counts(const uint16_t* in, size_t n, uint32_t, int* out) {
+  copy(in, in + n, out);
+}
+
+void decode_counts(const uint8_t* in, size_t n, uint32_t iterations,
+                   int* out) {
+  // a render never yields less than one iteration per pixel
+  auto limit = static_cast<int>(max(iterations, uint32_t{1}));
+  for (size_t i = 0; i < n; ++i)
+    out[i] = (in[i] & 0x80) != 0 ? in[i] & 0x7F : limit;
+}
@@ -1,100 +1,160 @@
 
 #include <array>
+#include <memory>
+#include <chrono>
 #include <vector>
-#include <future>
 #include <numeric>
 #include <iomanip>
 #include <iostream>
 #include <algorithm>
 
+#ifdef ENABLE_PARALLEL_STL
+#include <execution>
+#endif
+
 #include "caf/all.hpp"
 
+#include "include/gemm.hpp"
 #include "include/config.hpp"
+#include "include/thread_pool.hpp"
+#include "include/work_stealing.hpp"
 
 using namespace std;
 using namespace caf;
 
 namespace {
 
-using matrix_type = vector<float>;
-
-inline float& get(matrix_type& m, size_t size, size_t col, size_t row) {
-  return m[size * row + col];
-}
-
-inline const float& get(const matrix_type& m, size_t size, size_t col, size_t row) {
-  return m[size * row + col];
-}
+#ifdef NDEBUG
+#define DEBUG(x)
+#else
+#define DEBUG(x) cerr << x << endl;
+#endif
 
-int dot_product(const matrix_type& lhs, const matrix_type& rhs,
-                size_t size, size_t column, size_t row) {
-  int result = 0.0f;
-  for (size_t k = 0; k < size; ++k)
-    result += get(lhs, size, k, row) * get(rhs, size, column, k);
-  return result;
-}
+using matrix_type = vector<float>;
 
-matrix_type simple_multiply(const matrix_type& lhs, const matrix_type& rhs, size_t size) {
+matrix_type simple_multiply(const gemm_engine& engine) {
+  auto size = engine.size();
   matrix_type result(size * size);
-  for (size_t row = 0; row < size; ++row)
-    for (size_t column = 0; column < size; ++column)
-      get(result, size, column, row) = dot_product(lhs, rhs, size, column, row);
+  engine.compute(result.data(), 0, size, 0, size);
   return result;
 }
 
-matrix_type actor_multiply(actor_system& sys,
-                           const matrix_type& lhs, const matrix_type& rhs,
-                           size_t size) {
+matrix_type actor_multiply(actor_system& sys, const gemm_engine& engine) {
+  auto size = engine.size();
   matrix_type result(size * size);
   for (size_t row = 0; row < size; ++row)
     for (size_t column = 0; column < size; ++column)
-      sys.spawn([&,row,column, size] {
-        get(result, size, column, row) = dot_product(lhs, rhs, size, column, row);
+      sys.spawn([&, row, column] {
+        engine.compute(result.data(), row, row + 1, column, column + 1);
       });
   sys.await_all_actors_done();
   return result;
 }
 
-matrix_type actor_multiply2(actor_system& sys,
-                           const matrix_type& lhs, const matrix_type& rhs,
-                           size_t size) {
+matrix_type actor_multiply2(actor_system& sys, const gemm_engine& engine) {
+  auto size = engine.size();
   matrix_type result(size * size);
   for (size_t row = 0; row < size; ++row)
-    sys.spawn([&,row, size] {
-      for (size_t column = 0; column < size; ++column)
-        get(result, size, column, row) = dot_product(lhs, rhs, size, column, row);
+    sys.spawn([&, row] {
+      engine.compute(result.data(), row, row + 1, 0, size);
     });
   sys.await_all_actors_done();
   return result;
 }
 
-matrix_type async_multiply(const matrix_type& lhs, const matrix_type& rhs, size_t size) {
+// One task per chunk of `chunk` cells, counted in row-major order.
+matrix_type async_multiply(thread_pool& pool, const gemm_engine& engine,
+                           size_t chunk) {
+  auto size = engine.size();
   matrix_type result(size * size);
-  vector<future<void>> futures;
-  futures.reserve(size * size);
-  for (size_t row = 0; row < size; ++row) {
-    for (size_t column = 0; column < size; ++column) {
-      futures.push_back(std::async(std::launch::async, [&,row,column, size] {
-        get(result, size, column, row) = dot_product(lhs, rhs, size, column, row);
-      }));
+  pool.parallel_for(0, size * size, chunk, [&](size_t first, size_t last) {
+    for (auto cell = first; cell < last; ++cell) {
+      auto row = cell / size;
+      auto column = cell % size;
+      engine.compute(result.data(), row, row + 1, column, column + 1);
     }
-  }
-  for (auto& f : futures)
-    f.wait();
+  });
   return result;
 }
 
-matrix_type async_multiply2(const matrix_type& lhs, const matrix_type& rhs, size_t size) {
+// One task per chunk of `chunk` rows.
+matrix_type async_multiply2(thread_pool& pool, const gemm_engine& engine,
+                            size_t chunk) {
+  auto size = engine.size();
   matrix_type result(size * size);
-  vector<future<void>> futures;
-  futures.reserve(size);
-  for (size_t row = 0; row < size; ++row)
-    futures.push_back(std::async(std::launch::async, [&,row, size] {
-      for (size_t column = 0; column < size; ++column)
-        get(result, size, column, row) = dot_product(lhs, rhs, size, column, row);
-    }));
-  for (auto& f : futures)
-    f.wait();
+  pool.parallel_for(0, size, chunk, [&](size_t first, size_t last) {
+    engine.compute(result.data(), first, last, 0, size);
+  });
+  return result;
+}
+
+#ifdef ENABLE_PARALLEL_STL
+// Leaves the decomposition of rows to the standard library.
+matrix_type par_multiply(const gemm_engine& engine) {
+  auto size = engine.size();
+  matrix_type result(size * size);
+  vector<size_t> rows(size);
+  iota(begin(rows), end(rows), 0);
+  for_each(execution::par, begin(rows), end(rows), [&](size_t row) {
+    engine.compute(result.data(), row, row + 1, 0, size);
+  });
+  return result;
+}
+#endif // ENABLE_PARALLEL_STL
+
+// Splits `range` into roughly four chunks per thread unless the user picked
+// a chunk size.
+size_t chunk_size(size_t configured, size_t range, size_t threads) {
+  if (configured > 0)
+    return configured;
+  return max(range / (4 * threads), size_t{1});
+}
+
+struct tile {
+  size_t row;
+  size_t column;
+};
+
+// Cuts the result into `tile_size` x `tile_size` tiles and runs them on a
+// fixed set of worker actors. Each worker starts with a contiguous share of
+// the tiles and steals from the others once its own deque runs dry.
+matrix_type tiled_multiply(actor_system& sys, const gemm_engine& engine,
+                           size_t tile_size, size_t workers,
+                           vector<worker_stats>& stats) {
+  auto size = engine.size();
+  matrix_type result(size * size);
+  vector<tile> tiles;
+  for (size_t row = 0; row < size; row += tile_size)
+    for (size_t column = 0; column < size; column += tile_size)
+      tiles.push_back(tile{row, column});
+  vector<work_stealing_deque<tile>> queues(workers);
+  for (size_t i = 0; i < tiles.size(); ++i)
+    queues[i * workers / tiles.size()].push(tiles[i]);
+  auto run = [&, size, tile_size](const tile& t) {
+    engine.compute(result.data(), t.row, min(t.row + tile_size, size),
+                   t.column, min(t.column + tile_size, size));
+  };
+  for (size_t id = 0; id < workers; ++id) {
+    sys.spawn([&, id, workers] {
+      tile t;
+      for (;;) {
+        if (queues[id].pop(t)) {
+          run(t);
+          ++stats[id].executed;
+          continue;
+        }
+        auto found = false;
+        for (size_t i = 1; i < workers && !found; ++i)
+          found = queues[(id + i) % workers].steal(t);
+        if (!found)
+          return;
+        run(t);
+        ++stats[id].executed;
+        ++stats[id].stolen;
+      }
+    });
+  }
+  sys.await_all_actors_done();
   return result;
 }
 
@@ -108,20 +168,87 @@ matrix_type create_matrix(size_t size) {
 class config : public actor_system_config {
 public:
   size_t size = 0;
+  string kernel = "naive";
+  string strategy = "actor2";
+  size_t tile_size = 128;
+  size_t workers = 0;
+  size_t chunk = 0;
   //  announce<vector<float>>("vector_float");
   config() {
     opt_group{custom_options_, "global"}
-    .add(size, "size,s", "set matrix size (must be > 0)");
+    .add(size, "size,s", "set matrix size (must be > 0)")
+    .add(kernel, "kernel,k", "inner kernel: naive, blocked or simd (naive)")
+    .add(strategy, "strategy,S", "parallelization: simple, actor, actor2, "
+                                 "async, async2, par or tiled (actor2)")
+    .add(tile_size, "tile,t", "edge length of tiles for the tiled strategy, "
+                              "128 keeps a result tile in L2 (128)")
+    .add(workers, "workers,w", "worker actors for the tiled strategy or "
+                               "pool threads for the async strategies "
+                               "(0 = one per scheduler thread)")
+    .add(chunk, "chunk,c", "cells (async) or rows (async2) per pool task "
+                           "(0 = four chunks per thread)");
   }
 };
 
 void caf_main(actor_system& system, const config& cfg) {
   auto matrix_size = cfg.size;
+  gemm_kernel kernel;
+  if (!parse_gemm_kernel(cfg.kernel, kernel)) {
+    cerr << "Unknown kernel '" << cfg.kernel << "'." << endl;
+    return;
+  }
+  if (kernel == gemm_kernel::simd)
+    DEBUG("SIMD kernel uses " << simd_isa());
 
   matrix_type m1 = create_matrix(matrix_size);
   matrix_type m2 = create_matrix(matrix_size);
 
-  matrix_type matrix = actor_multiply2(system, m1, m2, matrix_size);
+  auto workers = cfg.workers > 0 ? cfg.workers : cfg.scheduler_max_threads;
+  workers = max(workers, size_t{1});
+  // the pool is not part of the measurement, just like the actor system
+  unique_ptr<thread_pool> pool;
+  if (cfg.strategy == "async" || cfg.strategy == "async2")
+    pool.reset(new thread_pool(workers));
+
+  auto start_ = chrono::high_resolution_clock::now();
+  gemm_engine engine{kernel, m1, m2, matrix_size};
+  matrix_type matrix;
+  vector<worker_stats> stats;
+  if (cfg.strategy == "simple") {
+    matrix = simple_multiply(engine);
+  } else if (cfg.strategy == "actor") {
+    matrix = actor_multiply(system, engine);
+  } else if (cfg.strategy == "actor2") {
+    matrix = actor_multiply2(system, engine);
+  } else if (cfg.strategy == "async") {
+    auto chunk = chunk_size(cfg.chunk, matrix_size * matrix_size, workers);
+    matrix = async_multiply(*pool, engine, chunk);
+  } else if (cfg.strategy == "async2") {
+    auto chunk = chunk_size(cfg.chunk, matrix_size, workers);
+    matrix = async_multiply2(*pool, engine, chunk);
+  } else if (cfg.strategy == "par") {
+#ifdef ENABLE_PARALLEL_STL
+    matrix = par_multiply(engine);
+#else
+    cerr << "Strategy 'par' requires a build with --enable-parallel-stl."
+         << endl;
+    return;
+#endif
+  } else if (cfg.strategy == "tiled") {
+    stats = vector<worker_stats>(workers);
+    matrix = tiled_multiply(system, engine, max(cfg.tile_size, size_t{1}),
+                            workers, stats);
+  } else {
+    cerr << "Unknown strategy '" << cfg.strategy << "'." << endl;
+    return;
+  }
+  auto end_ = chrono::high_resolution_clock::now();
+  cout << chrono::duration_cast<chrono::microseconds>((end_ - start_)).count()
+       << endl;
+  // load balance of the tiled strategy: worker, tiles executed, tiles stolen
+  for (size_t id = 0; id < stats.size(); ++id)
+    cerr << id << ", " << stats[id].executed << ", " << stats[id].stolen
+         << endl;
 
 #ifdef CL_ENABLE_DEBUG
   for (size_t column = 0; column < matrix_size; ++column) {
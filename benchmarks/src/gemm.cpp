@@ -0,0 +1,280 @@
+#include <cstring>
+#include <algorithm>
+
+#include "include/gemm.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define GEMM_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+constexpr size_t mr = gemm_engine::block_rows;
+constexpr size_t nr = gemm_engine::block_cols;
+
+// Adds the product of `mr` rows of `a` and one packed panel `b` over `depth`
+// elements into `c`. Only full tiles are passed to micro kernels.
+using micro_kernel = void (*)(size_t depth, const float* a, size_t lda,
+                              const float* b, float* c, size_t ldc);
+
+// Portable four-lane vector, lowered to SSE/NEON or plain scalar code by the
+// compiler. Written explicitly since auto-vectorization picks the wrong loop.
+typedef float vec4 __attribute__((vector_size(16)));
+
+inline vec4 load4(const float* ptr) {
+  vec4 result;
+  memcpy(&result, ptr, sizeof(vec4));
+  return result;
+}
+
+void micro_scalar(size_t depth, const float* a, size_t lda,
+                  const float* b, float* c, size_t ldc) {
+  // One row at a time keeps the accumulators in registers, the packed panel
+  // stays in L1 across the rows.
+  for (size_t i = 0; i < mr; ++i) {
+    vec4 acc[nr / 4] = {};
+    for (size_t k = 0; k < depth; ++k) {
+      auto a_ik = a[i * lda + k];
+      for (size_t j = 0; j < nr / 4; ++j)
+        acc[j] += a_ik * load4(b + k * nr + j * 4);
+    }
+    for (size_t j = 0; j < nr / 4; ++j)
+      for (size_t lane = 0; lane < 4; ++lane)
+        c[i * ldc + j * 4 + lane] += acc[j][lane];
+  }
+}
+
+// Handles tiles at the borders of the requested range, i.e., less than
+// `mr` rows or only the columns [first, last) of a panel.
+void edge_scalar(size_t depth, const float* a, size_t lda,
+                 const float* b, float* c, size_t ldc,
+                 size_t rows, size_t first, size_t last) {
+  float acc[mr][nr] = {};
+  for (size_t k = 0; k < depth; ++k) {
+    for (size_t i = 0; i < rows; ++i) {
+      auto a_ik = a[i * lda + k];
+      for (size_t j = first; j < last; ++j)
+        acc[i][j] += a_ik * b[k * nr + j];
+    }
+  }
+  for (size_t i = 0; i < rows; ++i)
+    for (size_t j = first; j < last; ++j)
+      c[i * ldc + j] += acc[i][j];
+}
+
+#ifdef GEMM_X86_DISPATCH
+
+__attribute__((target("avx2,fma")))
+inline void add_avx2(float* dst, __m256 val) {
+  _mm256_storeu_ps(dst, _mm256_add_ps(_mm256_loadu_ps(dst), val));
+}
+
+__attribute__((target("avx2,fma")))
+void micro_avx2(size_t depth, const float* a, size_t lda,
+                const float* b, float* c, size_t ldc) {
+  __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+  __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+  __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+  __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+  for (size_t k = 0; k < depth; ++k) {
+    auto b0 = _mm256_loadu_ps(b + k * nr);
+    auto b1 = _mm256_loadu_ps(b + k * nr + 8);
+    auto a0 = _mm256_broadcast_ss(a + k);
+    c00 = _mm256_fmadd_ps(a0, b0, c00);
+    c01 = _mm256_fmadd_ps(a0, b1, c01);
+    auto a1 = _mm256_broadcast_ss(a + lda + k);
+    c10 = _mm256_fmadd_ps(a1, b0, c10);
+    c11 = _mm256_fmadd_ps(a1, b1, c11);
+    auto a2 = _mm256_broadcast_ss(a + 2 * lda + k);
+    c20 = _mm256_fmadd_ps(a2, b0, c20);
+    c21 = _mm256_fmadd_ps(a2, b1, c21);
+    auto a3 = _mm256_broadcast_ss(a + 3 * lda + k);
+    c30 = _mm256_fmadd_ps(a3, b0, c30);
+    c31 = _mm256_fmadd_ps(a3, b1, c31);
+  }
+  add_avx2(c, c00);
+  add_avx2(c + 8, c01);
+  add_avx2(c + ldc, c10);
+  add_avx2(c + ldc + 8, c11);
+  add_avx2(c + 2 * ldc, c20);
+  add_avx2(c + 2 * ldc + 8, c21);
+  add_avx2(c + 3 * ldc, c30);
+  add_avx2(c + 3 * ldc + 8, c31);
+}
+
+__attribute__((target("avx512f")))
+void micro_avx512(size_t depth, const float* a, size_t lda,
+                  const float* b, float* c, size_t ldc) {
+  __m512 c0 = _mm512_setzero_ps();
+  __m512 c1 = _mm512_setzero_ps();
+  __m512 c2 = _mm512_setzero_ps();
+  __m512 c3 = _mm512_setzero_ps();
+  for (size_t k = 0; k < depth; ++k) {
+    auto bk = _mm512_loadu_ps(b + k * nr);
+    c0 = _mm512_fmadd_ps(_mm512_set1_ps(a[k]), bk, c0);
+    c1 = _mm512_fmadd_ps(_mm512_set1_ps(a[lda + k]), bk, c1);
+    c2 = _mm512_fmadd_ps(_mm512_set1_ps(a[2 * lda + k]), bk, c2);
+    c3 = _mm512_fmadd_ps(_mm512_set1_ps(a[3 * lda + k]), bk, c3);
+  }
+  _mm512_storeu_ps(c, _mm512_add_ps(_mm512_loadu_ps(c), c0));
+  _mm512_storeu_ps(c + ldc, _mm512_add_ps(_mm512_loadu_ps(c + ldc), c1));
+  _mm512_storeu_ps(c + 2 * ldc,
+                   _mm512_add_ps(_mm512_loadu_ps(c + 2 * ldc), c2));
+  _mm512_storeu_ps(c + 3 * ldc,
+                   _mm512_add_ps(_mm512_loadu_ps(c + 3 * ldc), c3));
+}
+
+#endif // GEMM_X86_DISPATCH
+
+enum class isa { scalar, avx2, avx512 };
+
+isa detect_isa() {
+#ifdef GEMM_X86_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return isa::avx512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return isa::avx2;
+#endif
+  return isa::scalar;
+}
+
+isa runtime_isa() {
+  static isa result = detect_isa();
+  return result;
+}
+
+micro_kernel select_micro_kernel(gemm_kernel kernel) {
+  if (kernel != gemm_kernel::simd)
+    return micro_scalar;
+#ifdef GEMM_X86_DISPATCH
+  switch (runtime_isa()) {
+    case isa::avx512:
+      return micro_avx512;
+    case isa::avx2:
+      return micro_avx2;
+    default:
+      break;
+  }
+#endif
+  return micro_scalar;
+}
+
+} // namespace <anonymous>
+
+constexpr size_t gemm_engine::block_rows;
+constexpr size_t gemm_engine::block_cols;
+constexpr size_t gemm_engine::block_depth;
+constexpr size_t gemm_engine::block_height;
+
+bool parse_gemm_kernel(const string& name, gemm_kernel& kernel) {
+  if (name == "naive")
+    kernel = gemm_kernel::naive;
+  else if (name == "blocked")
+    kernel = gemm_kernel::blocked;
+  else if (name == "simd")
+    kernel = gemm_kernel::simd;
+  else
+    return false;
+  return true;
+}
+
+const char* to_string(gemm_kernel kernel) {
+  switch (kernel) {
+    case gemm_kernel::naive:
+      return "naive";
+    case gemm_kernel::blocked:
+      return "blocked";
+    default:
+      return "simd";
+  }
+}
+
+const char* simd_isa() {
+  switch (runtime_isa()) {
+    case isa::avx512:
+      return "avx512";
+    case isa::avx2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
+
+gemm_engine::gemm_engine(gemm_kernel kernel, const vector<float>& lhs,
+                         const vector<float>& rhs, size_t size)
+    : kernel_(kernel),
+      lhs_(lhs.data()),
+      rhs_(rhs.data()),
+      size_(size) {
+  if (kernel_ == gemm_kernel::naive)
+    return;
+  // Panel p holds the columns [p * nr, (p + 1) * nr) of the rhs, one row of
+  // `nr` consecutive values per k. Columns beyond `size` are zero padded.
+  auto panels = (size_ + nr - 1) / nr;
+  packed_.assign(panels * size_ * nr, 0.0f);
+  for (size_t p = 0; p < panels; ++p) {
+    auto cols = min(nr, size_ - p * nr);
+    for (size_t k = 0; k < size_; ++k)
+      copy_n(rhs_ + k * size_ + p * nr, cols,
+             packed_.data() + (p * size_ + k) * nr);
+  }
+}
+
+void gemm_engine::compute(float* result, size_t row_first, size_t row_last,
+                          size_t col_first, size_t col_last) const {
+  if (kernel_ == gemm_kernel::naive)
+    compute_naive(result, row_first, row_last, col_first, col_last);
+  else
+    compute_packed(result, row_first, row_last, col_first, col_last);
+}
+
+void gemm_engine::compute_naive(float* result,
+                                size_t row_first, size_t row_last,
+                                size_t col_first, size_t col_last) const {
+  for (size_t row = row_first; row < row_last; ++row) {
+    for (size_t col = col_first; col < col_last; ++col) {
+      float sum = 0.0f;
+      for (size_t k = 0; k < size_; ++k)
+        sum += lhs_[row * size_ + k] * rhs_[k * size_ + col];
+      result[row * size_ + col] = sum;
+    }
+  }
+}
+
+void gemm_engine::compute_packed(float* result,
+                                 size_t row_first, size_t row_last,
+                                 size_t col_first, size_t col_last) const {
+  auto micro = select_micro_kernel(kernel_);
+  for (size_t row = row_first; row < row_last; ++row)
+    fill(result + row * size_ + col_first, result + row * size_ + col_last,
+         0.0f);
+  auto first_panel = col_first / nr;
+  auto last_panel = (col_last + nr - 1) / nr;
+  // Loop order: slices of the rhs that fit into L1, blocks of lhs rows that
+  // fit into L2, then panels and register tiles within the block.
+  for (size_t k0 = 0; k0 < size_; k0 += block_depth) {
+    auto depth = min(block_depth, size_ - k0);
+    for (size_t r0 = row_first; r0 < row_last; r0 += block_height) {
+      auto r1 = min(r0 + block_height, row_last);
+      for (size_t p = first_panel; p < last_panel; ++p) {
+        auto panel_col = p * nr;
+        auto first = col_first > panel_col ? col_first - panel_col : 0;
+        auto last = min(nr, col_last - panel_col);
+        auto b = packed_.data() + (p * size_ + k0) * nr;
+        for (size_t row = r0; row < r1; row += mr) {
+          auto rows = min(mr, r1 - row);
+          auto a = lhs_ + row * size_ + k0;
+          auto c = result + row * size_ + panel_col;
+          if (rows == mr && first == 0 && last == nr)
+            micro(depth, a, size_, b, c, size_);
+          else
+            edge_scalar(depth, a, size_, b, c, size_, rows, first, last);
+        }
+      }
+    }
+  }
+}
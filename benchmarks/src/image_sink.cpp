@@ -0,0 +1,134 @@
+#include <cerrno>
+#include <chrono>
+#include <string>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "include/image_sink.hpp"
+
+using namespace std;
+
+namespace {
+
+[[noreturn]] void fail(const string& what, const string& path) {
+  throw runtime_error("'" + what + "' failed for '" + path + "': "
+                      + strerror(errno));
+}
+
+} // namespace <anonymous>
+
+bool parse_image_format(const string& name, image_format& format) {
+  if (name == "pgm")
+    format = image_format::pgm;
+  else if (name == "raw")
+    format = image_format::raw;
+  else
+    return false;
+  return true;
+}
+
+const char* to_string(image_format format) {
+  switch (format) {
+    case image_format::raw:
+      return "raw";
+    default:
+      return "pgm";
+  }
+}
+
+image_sink::image_sink(const string& path, image_format format,
+                       uint32_t width, uint32_t height, uint32_t max_count)
+    : format_(format),
+      width_(width),
+      max_count_(max_count),
+      sample_bytes_(sizeof(int32_t)),
+      header_bytes_(0),
+      size_(0),
+      fd_(-1),
+      data_(nullptr),
+      bytes_(0),
+      write_ns_(0) {
+  string header;
+  if (format == image_format::pgm) {
+    // PGM allows at most 16 bit samples, the maximum must be positive
+    max_count_ = max(min(max_count, uint32_t{65535}), uint32_t{1});
+    sample_bytes_ = max_count_ < 256 ? 1 : 2;
+    header = "P5\n" + to_string(width) + " " + to_string(height) + "\n"
+             + to_string(max_count_) + "\n";
+    header_bytes_ = header.size();
+  }
+  size_ = header_bytes_ + size_t{width} * height * sample_bytes_;
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0)
+    fail("open", path);
+  if (ftruncate(fd_, static_cast<off_t>(size_)) != 0) {
+    close(fd_);
+    fail("ftruncate", path);
+  }
+  auto addr = mmap(nullptr, max(size_, size_t{1}), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd_, 0);
+  if (addr == MAP_FAILED) {
+    close(fd_);
+    fail("mmap", path);
+  }
+  data_ = static_cast<unsigned char*>(addr);
+  memcpy(data_, header.data(), header.size());
+}
+
+image_sink::~image_sink() {
+  munmap(data_, max(size_, size_t{1}));
+  close(fd_);
+}
+
+void image_sink::write_rows(uint32_t first, uint32_t rows,
+                            const int* counts) {
+  auto start = chrono::steady_clock::now();
+  auto n = size_t{rows} * width_;
+  auto begin = data_ + header_bytes_ + size_t{first} * width_ * sample_bytes_;
+  auto end = begin + n * sample_bytes_;
+  auto clamp = [&](int count) {
+    return min(static_cast<uint32_t>(max(count, 0)), max_count_);
+  };
+  switch (sample_bytes_) {
+    case 1:
+      for (size_t i = 0; i < n; ++i)
+        begin[i] = static_cast<unsigned char>(clamp(counts[i]));
+      break;
+    case 2:
+      // PGM stores 16 bit samples most significant byte first
+      for (size_t i = 0; i < n; ++i) {
+        auto x = clamp(counts[i]);
+        begin[2 * i] = static_cast<unsigned char>(x >> 8);
+        begin[2 * i + 1] = static_cast<unsigned char>(x & 0xFF);
+      }
+      break;
+    default:
+      memcpy(begin, counts, n * sizeof(int32_t));
+  }
+  // Dropping the pages only unmaps them from the process, dirty pages stay
+  // in the page cache until the kernel writes them back. Pages shared with
+  // neighboring rows simply fault in again on their next write.
+  auto page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+  auto from = reinterpret_cast<uintptr_t>(begin) & ~(page - 1);
+  madvise(reinterpret_cast<void*>(from),
+          static_cast<size_t>(reinterpret_cast<uintptr_t>(end) - from),
+          MADV_DONTNEED);
+  bytes_ += n * sample_bytes_;
+  write_ns_ += chrono::duration_cast<chrono::nanoseconds>(
+    chrono::steady_clock::now() - start
+  ).count();
+}
+
+uint64_t image_sink::flush() {
+  auto start = chrono::steady_clock::now();
+  if (msync(data_, max(size_, size_t{1}), MS_SYNC) != 0)
+    throw runtime_error(string{"'msync' failed: "} + strerror(errno));
+  return chrono::duration_cast<chrono::nanoseconds>(
+    chrono::steady_clock::now() - start
+  ).count();
+}
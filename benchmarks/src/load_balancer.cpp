@@ -0,0 +1,102 @@
+#include <limits>
+#include <iostream>
+
+#include "include/load_balancer.hpp"
+
+using namespace std;
+using namespace caf;
+
+bool parse_balance_policy(const string& str, balance_policy& policy) {
+  if (str == "round-robin")
+    policy = balance_policy::round_robin;
+  else if (str == "least-outstanding")
+    policy = balance_policy::least_outstanding;
+  else if (str == "throughput-weighted")
+    policy = balance_policy::throughput_weighted;
+  else
+    return false;
+  return true;
+}
+
+string to_string(balance_policy policy) {
+  switch (policy) {
+    case balance_policy::round_robin:
+      return "round-robin";
+    case balance_policy::least_outstanding:
+      return "least-outstanding";
+    case balance_policy::throughput_weighted:
+      return "throughput-weighted";
+  }
+  return "?";
+}
+
+load_balancer::load_balancer(actor_config& cfg, vector<actor> workers,
+                             vector<string> labels, balance_policy policy)
+    : event_based_actor(cfg),
+      policy_(policy),
+      next_(0) {
+  for (size_t i = 0; i < workers.size(); ++i) {
+    worker_state state;
+    state.handle = move(workers[i]);
+    state.label = i < labels.size() ? labels[i] : to_string(i);
+    workers_.push_back(move(state));
+  }
+}
+
+behavior load_balancer::make_behavior() {
+  return {
+    [=](vector<float>& m1, vector<float>& m2) {
+      auto i = pick();
+      ++workers_[i].outstanding;
+      auto start = clock::now();
+      auto rp = make_response_promise();
+      request(workers_[i].handle, infinite, move(m1), move(m2)).then(
+        [=](vector<float>& result) mutable {
+          auto& w = workers_[i];
+          auto us = chrono::duration_cast<chrono::microseconds>(
+            clock::now() - start
+          ).count();
+          --w.outstanding;
+          ++w.completed;
+          w.total_us += us;
+          w.avg_us = w.completed == 1 ? us : 0.8 * w.avg_us + 0.2 * us;
+          rp.deliver(move(result));
+        }
+      );
+      return rp;
+    }
+  };
+}
+
+void load_balancer::on_exit() {
+  for (auto& w : workers_)
+    cerr << "balancer, " << to_string(policy_) << ", " << w.label << ", "
+         << w.completed << ", "
+         << (w.completed > 0 ? w.total_us / w.completed : 0.0) << endl;
+  workers_.clear();
+}
+
+size_t load_balancer::pick() {
+  auto n = workers_.size();
+  auto start = next_++ % n;
+  if (policy_ == balance_policy::round_robin)
+    return start;
+  // scan from a rotating start so that ties spread across workers
+  auto best = start;
+  auto best_cost = numeric_limits<double>::max();
+  for (size_t k = 0; k < n; ++k) {
+    auto i = (start + k) % n;
+    auto& w = workers_[i];
+    double cost = w.outstanding;
+    if (policy_ == balance_policy::throughput_weighted) {
+      // workers without a measurement get a job first to obtain one
+      cost = w.completed == 0 ? (w.outstanding == 0 ? -1 : cost * 1e9)
+                              : (w.outstanding + 1) * w.avg_us;
+    }
+    if (cost < best_cost) {
+      best = i;
+      best_cost = cost;
+    }
+  }
+  return best;
+}
@@ -0,0 +1,394 @@
+#include <algorithm>
+#include <type_traits>
+
+#include "include/mandelbrot.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MANDELBROT_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// Renders the pixels [first, last) of the row `fixed` or, if `vertical`, of
+// the column `fixed`. Pixel i is stored at `out[i * stride]`.
+using line_kernel = void (*)(const mandelbrot_view& view, uint32_t fixed,
+                             bool vertical, uint32_t first, uint32_t last,
+                             int* out, size_t stride);
+
+// Returns true if `c` lies in the main cardioid or the period-2 bulb.
+inline bool in_interior(float_type c_re, float_type c_im) {
+  auto q_re = c_re - float_type{0.25};
+  auto im2 = c_im * c_im;
+  auto q = q_re * q_re + im2;
+  auto bulb_re = c_re + 1;
+  return q * (q + q_re) < float_type{0.25} * im2
+         || bulb_re * bulb_re + im2 < float_type{0.0625};
+}
+
+// With `SkipInterior`, points in the cardioid or bulb are not iterated and
+// orbits that return to a saved value exactly are cut short, the saved
+// value moves at powers of two (Brent). Both points never escape, i.e.,
+// they get the same count as with brute force.
+template <bool SkipInterior>
+int pixel_scalar(float_type const_re, float_type const_im,
+                 uint32_t iterations) {
+  // the do-while loop runs at least once
+  auto limit = iterations > 0 ? iterations : 1;
+  if (SkipInterior && in_interior(const_re, const_im))
+    return static_cast<int>(limit);
+  auto z_re = const_re;
+  auto z_im = const_im;
+  auto saved_re = z_re;
+  auto saved_im = z_im;
+  uint32_t next_save = 2;
+  uint32_t cnt = 0;
+  float_type cond = 0;
+  do {
+    auto tmp_re = z_re;
+    auto tmp_im = z_im;
+    z_re = (tmp_re * tmp_re - tmp_im * tmp_im) + const_re;
+    z_im = (2 * tmp_re * tmp_im) + const_im;
+    cond = z_re * z_re + z_im * z_im;
+    ++cnt;
+    if (SkipInterior && cond <= 4.0f) {
+      if (z_re == saved_re && z_im == saved_im) {
+        cnt = limit;
+        break;
+      }
+      if (cnt == next_save) {
+        saved_re = z_re;
+        saved_im = z_im;
+        next_save *= 2;
+      }
+    }
+  } while (cnt < iterations && cond <= 4.0f);
+  return static_cast<int>(cnt);
+}
+
+template <bool SkipInterior>
+void line_scalar(const mandelbrot_view& view, uint32_t fixed, bool vertical,
+                 uint32_t first, uint32_t last, int* out, size_t stride) {
+  auto re_factor = view.re_factor();
+  auto im_factor = view.im_factor();
+  for (auto i = first; i < last; ++i) {
+    auto re = vertical ? fixed : i;
+    auto im = vertical ? i : fixed;
+    out[i * stride] = pixel_scalar<SkipInterior>(view.min_re + re * re_factor,
+                                                 view.max_im - im * im_factor,
+                                                 view.iterations);
+  }
+}
+
+#ifdef MANDELBROT_X86_DISPATCH
+
+// The vector kernels follow the arithmetic of `pixel_scalar` step by step
+// (no FMA), lanes that escaped keep iterating but stop counting. A block
+// ends once all lanes escaped. Lanes past the end of a line start out
+// inactive and are not stored. Lane offsets are added in single precision,
+// which is exact for lines of up to 2^24 pixels.
+
+__attribute__((target("avx2")))
+inline __m256 interior_avx2(__m256 c_re, __m256 c_im) {
+  auto q_re = _mm256_sub_ps(c_re, _mm256_set1_ps(0.25f));
+  auto im2 = _mm256_mul_ps(c_im, c_im);
+  auto q = _mm256_add_ps(_mm256_mul_ps(q_re, q_re), im2);
+  auto cardioid = _mm256_cmp_ps(_mm256_mul_ps(q, _mm256_add_ps(q, q_re)),
+                                _mm256_mul_ps(_mm256_set1_ps(0.25f), im2),
+                                _CMP_LT_OQ);
+  auto bulb_re = _mm256_add_ps(c_re, _mm256_set1_ps(1.0f));
+  auto bulb = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(bulb_re, bulb_re),
+                                          im2),
+                            _mm256_set1_ps(0.0625f), _CMP_LT_OQ);
+  return _mm256_or_ps(cardioid, bulb);
+}
+
+template <bool SkipInterior>
+__attribute__((target("avx2")))
+__m256i block_avx2(__m256 const_re, __m256 const_im, __m256 active,
+                   uint32_t iterations) {
+  // the do-while loop of the scalar kernel runs at least once
+  iterations = iterations > 0 ? iterations : 1;
+  auto limit = _mm256_set1_epi32(static_cast<int>(iterations));
+  auto four = _mm256_set1_ps(4.0f);
+  auto z_re = const_re;
+  auto z_im = const_im;
+  auto counts = _mm256_setzero_si256();
+  if (SkipInterior) {
+    auto inside = _mm256_and_ps(interior_avx2(const_re, const_im), active);
+    counts = _mm256_and_si256(_mm256_castps_si256(inside), limit);
+    active = _mm256_andnot_ps(inside, active);
+  }
+  auto saved_re = z_re;
+  auto saved_im = z_im;
+  uint32_t next_save = 2;
+  for (uint32_t cnt = 0;
+       cnt < iterations && _mm256_movemask_ps(active) != 0; ++cnt) {
+    auto re_im = _mm256_mul_ps(z_re, z_im);
+    z_re = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(z_re, z_re),
+                                       _mm256_mul_ps(z_im, z_im)),
+                         const_re);
+    z_im = _mm256_add_ps(_mm256_add_ps(re_im, re_im), const_im);
+    auto cond = _mm256_add_ps(_mm256_mul_ps(z_re, z_re),
+                              _mm256_mul_ps(z_im, z_im));
+    // subtracting -1 counts the step for active lanes
+    counts = _mm256_sub_epi32(counts, _mm256_castps_si256(active));
+    active = _mm256_and_ps(active, _mm256_cmp_ps(cond, four, _CMP_LE_OQ));
+    if (SkipInterior) {
+      auto periodic = _mm256_and_ps(
+        active,
+        _mm256_and_ps(_mm256_cmp_ps(z_re, saved_re, _CMP_EQ_OQ),
+                      _mm256_cmp_ps(z_im, saved_im, _CMP_EQ_OQ)));
+      counts = _mm256_blendv_epi8(counts, limit,
+                                  _mm256_castps_si256(periodic));
+      active = _mm256_andnot_ps(periodic, active);
+      if (cnt + 1 == next_save) {
+        saved_re = z_re;
+        saved_im = z_im;
+        next_save *= 2;
+      }
+    }
+  }
+  return counts;
+}
+
+template <bool SkipInterior>
+__attribute__((target("avx2")))
+void line_avx2(const mandelbrot_view& view, uint32_t fixed, bool vertical,
+               uint32_t first, uint32_t last, int* out, size_t stride) {
+  auto re_factor = _mm256_set1_ps(view.re_factor());
+  auto im_factor = _mm256_set1_ps(view.im_factor());
+  auto min_re = _mm256_set1_ps(view.min_re);
+  auto max_im = _mm256_set1_ps(view.max_im);
+  auto lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+  auto lane_ids = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  auto fixed_index = _mm256_set1_ps(static_cast<float>(fixed));
+  for (auto i = first; i < last; i += 8) {
+    auto n = min(last - i, uint32_t{8});
+    // all bits set for lanes that did not escape yet
+    auto active = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(n)),
+                                     lane_ids);
+    auto index = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(i)), lanes);
+    auto re = vertical ? fixed_index : index;
+    auto im = vertical ? index : fixed_index;
+    auto counts = block_avx2<SkipInterior>(
+      _mm256_add_ps(min_re, _mm256_mul_ps(re, re_factor)),
+      _mm256_sub_ps(max_im, _mm256_mul_ps(im, im_factor)),
+      _mm256_castsi256_ps(active), view.iterations);
+    if (stride == 1 && n == 8) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), counts);
+    } else if (stride == 1) {
+      _mm256_maskstore_epi32(out + i, active, counts);
+    } else {
+      alignas(32) int tmp[8];
+      _mm256_store_si256(reinterpret_cast<__m256i*>(tmp), counts);
+      for (uint32_t lane = 0; lane < n; ++lane)
+        out[(i + lane) * stride] = tmp[lane];
+    }
+  }
+}
+
+__attribute__((target("avx512f")))
+inline __mmask16 interior_avx512(__m512 c_re, __m512 c_im) {
+  auto q_re = _mm512_sub_ps(c_re, _mm512_set1_ps(0.25f));
+  auto im2 = _mm512_mul_ps(c_im, c_im);
+  auto q = _mm512_add_ps(_mm512_mul_ps(q_re, q_re), im2);
+  auto cardioid = _mm512_cmp_ps_mask(
+    _mm512_mul_ps(q, _mm512_add_ps(q, q_re)),
+    _mm512_mul_ps(_mm512_set1_ps(0.25f), im2), _CMP_LT_OQ);
+  auto bulb_re = _mm512_add_ps(c_re, _mm512_set1_ps(1.0f));
+  auto bulb = _mm512_cmp_ps_mask(
+    _mm512_add_ps(_mm512_mul_ps(bulb_re, bulb_re), im2),
+    _mm512_set1_ps(0.0625f), _CMP_LT_OQ);
+  return static_cast<__mmask16>(cardioid | bulb);
+}
+
+template <bool SkipInterior>
+__attribute__((target("avx512f")))
+__m512i block_avx512(__m512 const_re, __m512 const_im, __mmask16 active,
+                     uint32_t iterations) {
+  iterations = iterations > 0 ? iterations : 1;
+  auto limit = _mm512_set1_epi32(static_cast<int>(iterations));
+  auto four = _mm512_set1_ps(4.0f);
+  auto one = _mm512_set1_epi32(1);
+  auto z_re = const_re;
+  auto z_im = const_im;
+  auto counts = _mm512_setzero_si512();
+  if (SkipInterior) {
+    auto inside = static_cast<__mmask16>(interior_avx512(const_re, const_im)
+                                         & active);
+    counts = _mm512_mask_mov_epi32(counts, inside, limit);
+    active = static_cast<__mmask16>(active & ~inside);
+  }
+  auto saved_re = z_re;
+  auto saved_im = z_im;
+  uint32_t next_save = 2;
+  for (uint32_t cnt = 0; cnt < iterations && active != 0; ++cnt) {
+    auto re_im = _mm512_mul_ps(z_re, z_im);
+    z_re = _mm512_add_ps(_mm512_sub_ps(_mm512_mul_ps(z_re, z_re),
+                                       _mm512_mul_ps(z_im, z_im)),
+                         const_re);
+    z_im = _mm512_add_ps(_mm512_add_ps(re_im, re_im), const_im);
+    auto cond = _mm512_add_ps(_mm512_mul_ps(z_re, z_re),
+                              _mm512_mul_ps(z_im, z_im));
+    counts = _mm512_mask_add_epi32(counts, active, counts, one);
+    active = _mm512_mask_cmp_ps_mask(active, cond, four, _CMP_LE_OQ);
+    if (SkipInterior) {
+      auto periodic = static_cast<__mmask16>(
+        _mm512_mask_cmp_ps_mask(active, z_re, saved_re, _CMP_EQ_OQ)
+        & _mm512_cmp_ps_mask(z_im, saved_im, _CMP_EQ_OQ));
+      counts = _mm512_mask_mov_epi32(counts, periodic, limit);
+      active = static_cast<__mmask16>(active & ~periodic);
+      if (cnt + 1 == next_save) {
+        saved_re = z_re;
+        saved_im = z_im;
+        next_save *= 2;
+      }
+    }
+  }
+  return counts;
+}
+
+template <bool SkipInterior>
+__attribute__((target("avx512f")))
+void line_avx512(const mandelbrot_view& view, uint32_t fixed, bool vertical,
+                 uint32_t first, uint32_t last, int* out, size_t stride) {
+  auto re_factor = _mm512_set1_ps(view.re_factor());
+  auto im_factor = _mm512_set1_ps(view.im_factor());
+  auto min_re = _mm512_set1_ps(view.min_re);
+  auto max_im = _mm512_set1_ps(view.max_im);
+  auto lanes = _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7,
+                              8, 9, 10, 11, 12, 13, 14, 15);
+  auto fixed_index = _mm512_set1_ps(static_cast<float>(fixed));
+  for (auto i = first; i < last; i += 16) {
+    auto n = min(last - i, uint32_t{16});
+    auto active = static_cast<__mmask16>((1u << n) - 1);
+    auto index = _mm512_add_ps(_mm512_set1_ps(static_cast<float>(i)), lanes);
+    auto re = vertical ? fixed_index : index;
+    auto im = vertical ? index : fixed_index;
+    auto counts = block_avx512<SkipInterior>(
+      _mm512_add_ps(min_re, _mm512_mul_ps(re, re_factor)),
+      _mm512_sub_ps(max_im, _mm512_mul_ps(im, im_factor)),
+      active, view.iterations);
+    if (stride == 1) {
+      _mm512_mask_storeu_epi32(out + i, active, counts);
+    } else {
+      alignas(64) int tmp[16];
+      _mm512_store_si512(tmp, counts);
+      for (uint32_t lane = 0; lane < n; ++lane)
+        out[(i + lane) * stride] = tmp[lane];
+    }
+  }
+}
+
+#endif // MANDELBROT_X86_DISPATCH
+
+enum class isa { scalar, avx2, avx512 };
+
+isa detect_isa() {
+#ifdef MANDELBROT_X86_DISPATCH
+  // the vector kernels compute in single precision
+  if (!is_same<float_type, float>::value)
+    return isa::scalar;
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return isa::avx512;
+  if (__builtin_cpu_supports("avx2"))
+    return isa::avx2;
+#endif
+  return isa::scalar;
+}
+
+isa runtime_isa() {
+  static isa result = detect_isa();
+  return result;
+}
+
+template <bool SkipInterior>
+line_kernel select_line_kernel(mandelbrot_kernel kernel) {
+  if (kernel != mandelbrot_kernel::simd)
+    return line_scalar<SkipInterior>;
+#ifdef MANDELBROT_X86_DISPATCH
+  switch (runtime_isa()) {
+    case isa::avx512:
+      return line_avx512<SkipInterior>;
+    case isa::avx2:
+      return line_avx2<SkipInterior>;
+    default:
+      break;
+  }
+#endif
+  return line_scalar<SkipInterior>;
+}
+
+line_kernel select_line_kernel(mandelbrot_kernel kernel, bool skip_interior) {
+  return skip_interior ? select_line_kernel<true>(kernel)
+                       : select_line_kernel<false>(kernel);
+}
+
+} // namespace <anonymous>
+
+bool parse_mandelbrot_kernel(const string& name, mandelbrot_kernel& kernel) {
+  if (name == "scalar")
+    kernel = mandelbrot_kernel::scalar;
+  else if (name == "simd")
+    kernel = mandelbrot_kernel::simd;
+  else
+    return false;
+  return true;
+}
+
+const char* to_string(mandelbrot_kernel kernel) {
+  switch (kernel) {
+    case mandelbrot_kernel::scalar:
+      return "scalar";
+    default:
+      return "simd";
+  }
+}
+
+const char* mandelbrot_isa() {
+  switch (runtime_isa()) {
+    case isa::avx512:
+      return "avx512";
+    case isa::avx2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
+
+mandelbrot_view mandelbrot_view::band(uint32_t first, uint32_t rows) const {
+  auto factor = im_factor();
+  mandelbrot_view result = *this;
+  result.height = rows;
+  result.max_im = max_im - first * factor;
+  result.min_im = result.max_im - (rows - 1) * factor;
+  return result;
+}
+
+void mandelbrot_rows(const mandelbrot_view& view, uint32_t first,
+                     uint32_t last, int* out, mandelbrot_kernel kernel,
+                     bool skip_interior) {
+  auto line = select_line_kernel(kernel, skip_interior);
+  for (uint32_t im = first; im < last; ++im) {
+    line(view, im, false, 0, view.width, out, 1);
+    out += view.width;
+  }
+}
+
+void mandelbrot_span(const mandelbrot_view& view, uint32_t row,
+                     uint32_t first, uint32_t last, int* out,
+                     mandelbrot_kernel kernel, bool skip_interior) {
+  auto line = select_line_kernel(kernel, skip_interior);
+  line(view, row, false, first, last, out, 1);
+}
+
+void mandelbrot_column(const mandelbrot_view& view, uint32_t column,
+                       uint32_t first, uint32_t last, int* out,
+                       mandelbrot_kernel kernel, bool skip_interior) {
+  auto line = select_line_kernel(kernel, skip_interior);
+  line(view, column, true, first, last, out, view.width);
+}
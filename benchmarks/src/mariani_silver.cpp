@@ -0,0 +1,99 @@
+#include <algorithm>
+
+#include "include/mariani_silver.hpp"
+
+using namespace std;
+
+mariani_silver::mariani_silver(const mandelbrot_view& view, int* image,
+                               uint32_t min_size)
+    : view_(view),
+      image_(image),
+      min_size_(max(min_size, uint32_t{2})),
+      iterated_(0),
+      filled_(0) {
+  // nop
+}
+
+ms_tile mariani_silver::root() const {
+  return {0, 0, view_.width - 1, view_.height - 1};
+}
+
+void mariani_silver::border(const ms_tile& t, vector<ms_line>& lines) const {
+  lines.push_back(ms_line{t.y0, t.x0, t.x1 + 1, false});
+  if (t.y1 == t.y0)
+    return;
+  lines.push_back(ms_line{t.y1, t.x0, t.x1 + 1, false});
+  if (t.y1 - t.y0 < 2)
+    return;
+  lines.push_back(ms_line{t.x0, t.y0 + 1, t.y1, true});
+  if (t.x1 != t.x0)
+    lines.push_back(ms_line{t.x1, t.y0 + 1, t.y1, true});
+}
+
+void mariani_silver::split(const ms_tile& t, vector<ms_line>& lines,
+                           vector<ms_tile>& children) {
+  if (t.inner_pixels() == 0)
+    return;
+  auto width = view_.width;
+  auto at = [&](uint32_t x, uint32_t y) {
+    return image_[size_t{y} * width + x];
+  };
+  auto count = at(t.x0, t.y0);
+  auto uniform = true;
+  for (auto x = t.x0; x <= t.x1 && uniform; ++x)
+    uniform = at(x, t.y0) == count && at(x, t.y1) == count;
+  for (auto y = t.y0 + 1; y < t.y1 && uniform; ++y)
+    uniform = at(t.x0, y) == count && at(t.x1, y) == count;
+  if (uniform) {
+    for (auto y = t.y0 + 1; y < t.y1; ++y)
+      fill(image_ + size_t{y} * width + t.x0 + 1,
+           image_ + size_t{y} * width + t.x1, count);
+    filled_ += t.inner_pixels();
+    return;
+  }
+  if (t.x1 - t.x0 <= min_size_ || t.y1 - t.y0 <= min_size_) {
+    for (auto y = t.y0 + 1; y < t.y1; ++y)
+      lines.push_back(ms_line{y, t.x0 + 1, t.x1, false});
+    return;
+  }
+  auto mx = t.x0 + (t.x1 - t.x0) / 2;
+  auto my = t.y0 + (t.y1 - t.y0) / 2;
+  lines.push_back(ms_line{my, t.x0 + 1, t.x1, false});
+  if (my - t.y0 > 1)
+    lines.push_back(ms_line{mx, t.y0 + 1, my, true});
+  if (t.y1 - my > 1)
+    lines.push_back(ms_line{mx, my + 1, t.y1, true});
+  children.push_back(ms_tile{t.x0, t.y0, mx, my});
+  children.push_back(ms_tile{mx, t.y0, t.x1, my});
+  children.push_back(ms_tile{t.x0, my, mx, t.y1});
+  children.push_back(ms_tile{mx, my, t.x1, t.y1});
+}
+
+void mariani_silver::compute(const vector<ms_line>& lines,
+                             mandelbrot_kernel kernel, bool skip_interior) {
+  for (auto& l : lines) {
+    if (l.vertical)
+      mandelbrot_column(view_, l.fixed, l.first, l.last, image_ + l.fixed,
+                        kernel, skip_interior);
+    else
+      mandelbrot_span(view_, l.fixed, l.first, l.last,
+                      image_ + size_t{l.fixed} * view_.width, kernel,
+                      skip_interior);
+  }
+  iterated_ += pixels(lines);
+}
+
+void mariani_silver::scatter(const vector<ms_line>& lines,
+                             const int* counts) {
+  for (auto& l : lines)
+    for (auto i = l.first; i < l.last; ++i)
+      image_[l.at(i, view_.width)] = *counts++;
+  iterated_ += pixels(lines);
+}
+
+uint64_t mariani_silver::pixels(const vector<ms_line>& lines) {
+  uint64_t result = 0;
+  for (auto& l : lines)
+    result += l.last - l.first;
+  return result;
+}
@@ -0,0 +1,118 @@
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include "include/autotuner.hpp"
+#include "include/offload_calibration.hpp"
+
+using namespace std;
+
+offload_costs fit_costs(const probe_sample& cpu, size_t cpu_workers,
+                        const vector<probe_sample>& cl) {
+  offload_costs result;
+  result.cpu_workers = max(cpu_workers, size_t{1});
+  if (cpu.iterations > 0)
+    result.cpu_ns_per_iteration = cpu.ns / cpu.iterations;
+  if (cl.empty())
+    return result;
+  double n = cl.size();
+  double sum_x = 0;
+  double sum_y = 0;
+  double sum_xx = 0;
+  double sum_xy = 0;
+  for (auto& s : cl) {
+    double x = s.iterations;
+    sum_x += x;
+    sum_y += s.ns;
+    sum_xx += x * x;
+    sum_xy += x * s.ns;
+  }
+  auto denom = n * sum_xx - sum_x * sum_x;
+  if (denom > 0)
+    result.cl_ns_per_iteration = (n * sum_xy - sum_x * sum_y) / denom;
+  // noisy samples may produce a negative slope or offset, neither is useful
+  if (result.cl_ns_per_iteration <= 0 && sum_x > 0)
+    result.cl_ns_per_iteration = sum_y / sum_x;
+  else
+    result.cl_overhead_ns = (sum_y - result.cl_ns_per_iteration * sum_x) / n;
+  result.cl_overhead_ns = max(result.cl_overhead_ns, 0.0);
+  return result;
+}
+
+vector<uint64_t> column_work(const vector<int>& counts, uint32_t width) {
+  vector<uint64_t> result(width);
+  for (size_t i = 0; i < counts.size(); ++i)
+    result[i % width] += static_cast<uint64_t>(counts[i]);
+  return result;
+}
+
+double predicted_makespan(const offload_costs& costs,
+                          const vector<uint64_t>& cpu_columns,
+                          const vector<uint64_t>& cl_columns,
+                          double scale, uint32_t percentage) {
+  // same split as the benchmark: the CPU renders the left columns
+  auto cut = cpu_columns.size() * (100 - percentage) / 100;
+  double cpu_work = 0;
+  for (size_t i = 0; i < cut; ++i)
+    cpu_work += cpu_columns[i];
+  double cl_work = 0;
+  for (size_t i = cut; i < cl_columns.size(); ++i)
+    cl_work += cl_columns[i];
+  auto cpu_ns = cpu_work * scale * costs.cpu_ns_per_iteration
+                / costs.cpu_workers;
+  auto cl_ns = percentage > 0 ? costs.cl_overhead_ns
+                                + cl_work * scale * costs.cl_ns_per_iteration
+                              : 0.0;
+  return max(cpu_ns, cl_ns);
+}
+
+uint32_t best_offload(const offload_costs& costs,
+                      const vector<uint64_t>& cpu_columns,
+                      const vector<uint64_t>& cl_columns,
+                      double scale, double* makespan_ns) {
+  uint32_t best = 0;
+  auto best_ns = numeric_limits<double>::max();
+  for (uint32_t percentage = 0; percentage <= 100; ++percentage) {
+    auto ns = predicted_makespan(costs, cpu_columns, cl_columns, scale,
+                                 percentage);
+    if (ns < best_ns) {
+      best = percentage;
+      best_ns = ns;
+    }
+  }
+  if (makespan_ns)
+    *makespan_ns = best_ns;
+  return best;
+}
+
+calibration_cache::calibration_cache(string path) : path_(move(path)) {
+  ifstream in{path_};
+  string line;
+  while (getline(in, line)) {
+    istringstream iss{line};
+    string identity, problem;
+    uint32_t percentage = 0;
+    // skips lines without a valid percentage instead of failing on them
+    if (getline(iss, identity, '\t') && getline(iss, problem, '\t')
+        && iss >> percentage && percentage <= 100)
+      entries_[identity + '\t' + problem] = percentage;
+  }
+}
+
+bool calibration_cache::find(cl_device_id device, const string& problem,
+                             uint32_t& percentage) const {
+  auto i = entries_.find(device_identity(device) + '\t' + problem);
+  if (i == entries_.end())
+    return false;
+  percentage = i->second;
+  return true;
+}
+
+void calibration_cache::store(cl_device_id device, const string& problem,
+                              uint32_t percentage) {
+  auto identity = device_identity(device);
+  entries_[identity + '\t' + problem] = percentage;
+  ofstream out{path_, ios::app};
+  out << identity << '\t' << problem << '\t' << percentage << endl;
+}
@@ -1,8 +1,11 @@
+#include <map>
 #include <chrono>
 #include <vector>
 #include <iomanip>
 #include <numeric>
+#include <sstream>
 #include <iostream>
+#include <algorithm>
 
 #include "util.hpp"
 
@@ -11,6 +14,10 @@
 
 #include "include/config.hpp"
 #include "include/kernel.hpp"
+#include "include/autotuner.hpp"
+#include "include/statistics.hpp"
+#include "include/load_balancer.hpp"
+#include "include/program_cache.hpp"
 
 using namespace std;
 using namespace caf;
@@ -71,23 +78,246 @@ private:
   actor worker_;
 };
 
+// Keeps up to `window` requests in flight instead of waiting for each
+// result before sending the next job.
+class windowed_multiplier : public event_based_actor {
+public:
+  using clock = chrono::high_resolution_clock;
+
+  windowed_multiplier(actor_config& cfg,
+                      size_t iterations,
+                      size_t matrix_size,
+                      size_t window,
+                      double kernel_us,
+                      actor worker)
+    : event_based_actor(cfg),
+      issued_(0),
+      completed_(0),
+      iterations_(iterations),
+      size_(matrix_size),
+      window_(window),
+      kernel_us_(kernel_us),
+      worker_(worker)
+  { }
+
+  behavior make_behavior() override {
+    return {
+      [=] (calc_atom) {
+        start_ = clock::now();
+        if (iterations_ == 0)
+          quit();
+        while (issued_ < iterations_ && in_flight_.size() < window_)
+          submit();
+      }
+    };
+  }
+
+private:
+  void submit() {
+    auto id = issued_++;
+    vector<float> m1(size_ * size_);
+    vector<float> m2(size_ * size_);
+    iota(m1.begin(), m1.end(), 0);
+    iota(m2.begin(), m2.end(), 0);
+    in_flight_.emplace(id, clock::now());
+    request(worker_, infinite, move(m1), move(m2)).then(
+      [=] (const vector<float>&) {
+        complete(id);
+      }
+    );
+  }
+
+  void complete(size_t id) {
+    auto i = in_flight_.find(id);
+    auto latency = chrono::duration_cast<chrono::microseconds>(
+      clock::now() - i->second
+    );
+    latencies_.push_back(latency.count());
+    in_flight_.erase(i);
+    if (++completed_ >= iterations_) {
+      report();
+      quit();
+    } else if (issued_ < iterations_) {
+      submit();
+    }
+  }
+
+  // Utilization is estimated from the kernel time measured by the tuner,
+  // or from the fastest round trip if the configuration was not tuned.
+  void report() {
+    auto elapsed = chrono::duration_cast<chrono::microseconds>(
+      clock::now() - start_
+    ).count();
+    auto latency = summarize(latencies_);
+    auto service_us = kernel_us_ > 0
+                      ? kernel_us_
+                      : *min_element(latencies_.begin(), latencies_.end());
+    auto per_second = elapsed > 0 ? completed_ * 1e6 / elapsed : 0.0;
+    auto utilization = elapsed > 0
+                       ? min(1.0, completed_ * service_us / elapsed)
+                       : 0.0;
+    cerr << "window, " << window_ << ", " << per_second << ", "
+         << utilization << ", " << latency.p50 << ", " << latency.p99 << endl;
+  }
+
+  size_t issued_;
+  size_t completed_;
+  size_t iterations_;
+  size_t size_;
+  size_t window_;
+  double kernel_us_;
+  actor worker_;
+  clock::time_point start_;
+  map<size_t, clock::time_point> in_flight_; // request ID -> send time
+  vector<double> latencies_;
+};
+
+// Uploads the input once and keeps the result of each iteration on the
+// device, only the last one is read back.
+class resident_multiplier : public event_based_actor {
+public:
+  resident_multiplier(actor_config& cfg,
+                      size_t iterations,
+                      size_t matrix_size,
+                      opencl::device_ptr dev,
+                      actor worker)
+    : event_based_actor(cfg),
+      count_(0),
+      iterations_(iterations),
+      size_(matrix_size),
+      dev_(move(dev)),
+      worker_(worker)
+  { }
+
+  behavior make_behavior() override {
+    vector<float> m1(size_ * size_);
+    vector<float> m2(size_ * size_);
+    iota(m1.begin(), m1.end(), 0);
+    iota(m2.begin(), m2.end(), 0);
+    m1_ = dev_->global_argument(m1);
+    m2_ = dev_->global_argument(m2);
+    return {
+      [=] (calc_atom) {
+        send(worker_, m1_, m2_);
+        ++count_;
+      },
+      [=] (mem_ref<float>& result) {
+        if (count_ >= iterations_) {
+          auto matrix = result.data();
+          if (!matrix) {
+            cerr << "Reading the result failed: "
+                 << system().render(matrix.error()) << endl;
+          } else {
+#ifdef CL_ENABLE_DEBUG
+            for (size_t column = 0; column < size_; ++column) {
+              for (size_t row = 0; row < size_; ++row) {
+                cout << fixed << setprecision(2) << setw(9)
+                     << (*matrix)[row + column * size_];
+              }
+              cout << endl;
+            }
+#endif
+          }
+          quit();
+        } else {
+          send(this, calc_atom::value);
+        }
+      }
+    };
+  }
+
+private:
+  size_t count_;
+  size_t iterations_;
+  size_t size_;
+  opencl::device_ptr dev_;
+  actor worker_;
+  mem_ref<float> m1_;
+  mem_ref<float> m2_;
+};
+
 class config : public actor_system_config {
 public:
   string device_name = "GeForce GT 650M";
   size_t size = 0;
   size_t iterations = 1;
+  string kernel = kernel_name;
+  bool tune = false;
+  string tuning_cache = "tuning.cache";
+  string program_cache = default_program_cache;
+  bool resident = false;
+  size_t window = 0;
+  string devices;
+  size_t workers_per_device = 1;
+  string policy = "round-robin";
   config() {
     load<opencl::manager>();
     opt_group{custom_options_, "global"}
     .add(device_name, "device,d", "device for computation (GeForce GT 650M, "
                       ", but will take first available device if not found)")
     .add(size, "size,s", "set matrix size (must be > 0)")
-    .add(iterations, "iterations,i", "set iterations (deault: 1)");
+    .add(iterations, "iterations,i", "set iterations (deault: 1)")
+    .add(kernel, "kernel,k", "matrix_mult, matrix_mult_tiled, "
+                             "matrix_mult_reg2, matrix_mult_reg4, "
+                             "matrix_mult_vec4 or auto (matrix_mult)")
+    .add(tune, "tune", "run the autotuner if the tuning cache has no entry")
+    .add(tuning_cache, "tuning-cache", "file with tuned launch configurations "
+                                       "(tuning.cache)")
+    .add(program_cache, "program-cache", "directory for compiled program "
+                                         "binaries, empty disables it "
+                                         "(program-cache)")
+    .add(resident, "resident,r", "upload the input once and keep results "
+                                 "on the device until the last iteration")
+    .add(window, "window,w", "number of requests in flight, 0 waits for "
+                             "each result before sending the next (0)")
+    .add(devices, "devices", "comma separated device names or 'all', spreads "
+                             "jobs across one worker per device")
+    .add(workers_per_device, "workers-per-device", "workers spawned on each "
+                                                   "device of --devices (1)")
+    .add(policy, "policy", "round-robin, least-outstanding or "
+                           "throughput-weighted (round-robin)");
   }
 };
 
+// Devices matching a comma separated list of names, all for 'all'.
+vector<opencl::device_ptr> find_devices(opencl::manager& mngr,
+                                        const string& names) {
+  vector<string> wanted;
+  istringstream iss{names};
+  string name;
+  while (getline(iss, name, ','))
+    wanted.push_back(name);
+  vector<opencl::device_ptr> result;
+  // the predicate never matches, it only visits every device
+  mngr.find_device_if([&](const opencl::device_ptr dev) {
+    if (names == "all"
+        || find(wanted.begin(), wanted.end(), dev->name()) != wanted.end())
+      result.push_back(dev);
+    return false;
+  });
+  return result;
+}
+
 void caf_main(actor_system& system, const config& cfg) {
   auto& mngr = system.opencl_manager();
+  balance_policy policy;
+  if (!parse_balance_policy(cfg.policy, policy)) {
+    cerr << "Unknown policy '" << cfg.policy << "'." << endl;
+    return;
+  }
+  vector<opencl::device_ptr> balanced;
+  if (!cfg.devices.empty()) {
+    if (cfg.resident) {
+      cerr << "Device memory references cannot be balanced across devices."
+           << endl;
+      return;
+    }
+    balanced = find_devices(mngr, cfg.devices);
+    if (balanced.empty()) {
+      cerr << "No device matches '" << cfg.devices << "'." << endl;
+      return;
+    }
+  }
   // get device named in config ...
   auto opt = mngr.find_device_if([&](const opencl::device_ptr dev) {
     if (cfg.device_name.empty())
@@ -102,14 +332,103 @@ void caf_main(actor_system& system, const config& cfg) {
     return;
   }
   auto dev = *opt;
-  auto prog = mngr.create_program(kernel_source, "", dev);
+  // candidates for the tuner, 'auto' lets it pick the kernel variant
+  vector<tuning_candidate> candidates;
+  for (auto& k : matrix_kernels) {
+    vector<size_t> global;
+    vector<size_t> local;
+    if ((cfg.kernel == "auto" || cfg.kernel == k.name)
+        && matrix_kernel_dims(k, cfg.size, global, local))
+      candidates.push_back(tuning_candidate{k.name, global, local});
+  }
+  if (candidates.empty()) {
+    cerr << "No kernel '" << cfg.kernel << "' for a matrix size of "
+         << cfg.size << "." << endl;
+    return;
+  }
+  tuning_cache cache{cfg.tuning_cache};
+  auto launch_for = [&](const opencl::device_ptr& d) {
+    launch_config result;
+    result.kernel = candidates.front().kernel;
+    result.global = candidates.front().global;
+    result.local = candidates.front().fixed_local;
+    auto problem = "matrix/" + cfg.kernel + "/" + to_string(cfg.size);
+    if (cache.find(raw_device_id(d), problem, result) || !cfg.tune)
+      return result;
+    // only the tuner needs input data
+    vector<float> ones(cfg.size * cfg.size, 1.0f);
+    tuning_arg arg{sizeof(float) * ones.size(), ones.data()};
+    tuned_config(cache, true, raw_device_id(d), problem, kernel_source,
+                 candidates, {arg, arg, arg}, result);
+    return result;
+  };
+  auto program_for = [&](const opencl::device_ptr& d) {
+    program_build_info build_info;
+    auto result = create_cached_program(d, kernel_source, "",
+                                        cfg.program_cache, &build_info);
+    print_build_info("program", build_info);
+    return result;
+  };
+  launch_config launch;
+  opencl::program_ptr prog;
+  // launch configuration and program of every balanced device
+  vector<pair<launch_config, opencl::program_ptr>> setups;
+  if (balanced.empty()) {
+    launch = launch_for(dev);
+    prog = program_for(dev);
+  } else {
+    for (auto& d : balanced)
+      setups.emplace_back(launch_for(d), program_for(d));
+    launch = setups.front().first;
+  }
+  auto range = to_nd_range(launch);
   {
     auto start_ = chrono::high_resolution_clock::now();
-    auto worker = mngr.spawn(prog, kernel_name,
-                             nd_range{dim_vec{cfg.size, cfg.size}},
-                             in<float>{}, in<float>{}, out<float>{});
-    auto mult = system.spawn<multiplier>(cfg.iterations, cfg.size, worker);
-    anon_send(mult, calc_atom::value);
+    if (!balanced.empty()) {
+      vector<actor> workers;
+      vector<string> labels;
+      for (size_t i = 0; i < balanced.size(); ++i) {
+        auto& setup = setups[i];
+        for (size_t j = 0; j < cfg.workers_per_device; ++j) {
+          workers.push_back(mngr.spawn(setup.second,
+                                       setup.first.kernel.c_str(),
+                                       to_nd_range(setup.first),
+                                       in<float>{}, in<float>{},
+                                       out<float>{}));
+          labels.push_back(balanced[i]->name() + "#" + to_string(j));
+        }
+      }
+      auto front = system.spawn<load_balancer>(move(workers), move(labels),
+                                               policy);
+      actor mult;
+      if (cfg.window > 0)
+        mult = system.spawn<windowed_multiplier>(cfg.iterations, cfg.size,
+                                                 cfg.window,
+                                                 launch.runtime_us, front);
+      else
+        mult = system.spawn<multiplier>(cfg.iterations, cfg.size, front);
+      anon_send(mult, calc_atom::value);
+    } else if (cfg.resident) {
+      auto worker = mngr.spawn(prog, launch.kernel.c_str(), range,
+                               in<float, mref>{}, in<float, mref>{},
+                               out<float, mref>{});
+      auto mult = system.spawn<resident_multiplier>(cfg.iterations, cfg.size,
+                                                    dev, worker);
+      anon_send(mult, calc_atom::value);
+    } else if (cfg.window > 0) {
+      auto worker = mngr.spawn(prog, launch.kernel.c_str(), range,
+                               in<float>{}, in<float>{}, out<float>{});
+      auto mult = system.spawn<windowed_multiplier>(cfg.iterations, cfg.size,
+                                                    cfg.window,
+                                                    launch.runtime_us,
+                                                    worker);
+      anon_send(mult, calc_atom::value);
+    } else {
+      auto worker = mngr.spawn(prog, launch.kernel.c_str(), range,
+                               in<float>{}, in<float>{}, out<float>{});
+      auto mult = system.spawn<multiplier>(cfg.iterations, cfg.size, worker);
+      anon_send(mult, calc_atom::value);
+    }
     system.await_all_actors_done();
     auto end_ = chrono::high_resolution_clock::now();
     cout << chrono::duration_cast<chrono::microseconds>((end_ - start_)).count()
@@ -2,6 +2,7 @@
 #include <string>
 #include <cstring>
 #include <numeric>
+#include <fstream>
 #include <iostream>
 
 #if defined __APPLE__ || defined(MACOSX)
@@ -14,27 +15,177 @@
 #include "include/util.hpp"
 #include "include/config.hpp"
 #include "include/kernel.hpp"
+#include "include/statistics.hpp"
+#include "include/buffer_pool.hpp"
+#include "include/program_cache.hpp"
 
 using namespace std;
 
+namespace {
+
+// Time when the first command of an iteration was queued. Zero-copy runs
+// have no upload commands.
+cl_ulong first_queued(const iteration_profile& p) {
+  if (p.upload[0].queued == 0)
+    return p.kernel.queued;
+  return min(p.upload[0].queued, p.upload[1].queued);
+}
+
+// Splits every iteration into device time for the upload, the kernel and
+// the download plus the remaining time between queueing the first command
+// and the end of the download, which is spent in host-side scheduling.
+void print_profile(const vector<iteration_profile>& profile,
+                   const string& raw_file) {
+  vector<double> upload;
+  vector<double> kernel;
+  vector<double> download;
+  vector<double> host_gap;
+  for (auto& p : profile) {
+    auto first = first_queued(p);
+    auto up = max(p.upload[0].end, p.upload[1].end)
+              - min(p.upload[0].start, p.upload[1].start);
+    auto krn = p.kernel.end - p.kernel.start;
+    auto down = p.download.end - p.download.start;
+    auto span = p.download.end - first;
+    auto busy = up + krn + down;
+    upload.push_back(up / 1000.0);
+    kernel.push_back(krn / 1000.0);
+    download.push_back(down / 1000.0);
+    host_gap.push_back(span > busy ? (span - busy) / 1000.0 : 0.0);
+  }
+  if (!raw_file.empty() && !profile.empty()) {
+    ofstream out{raw_file};
+    out << "iteration, command, queued, submit, start, end" << endl;
+    auto origin = first_queued(profile.front());
+    for (size_t i = 0; i < profile.size(); ++i) {
+      auto& p = profile[i];
+      pair<const char*, const command_times*> commands[] = {
+        {"upload", &p.upload[0]}, {"upload", &p.upload[1]},
+        {"kernel", &p.kernel}, {"download", &p.download}
+      };
+      for (auto& cmd : commands)
+        if (cmd.second->queued != 0)
+          out << i << ", " << cmd.first << ", "
+              << cmd.second->queued - origin << ", "
+              << cmd.second->submit - origin << ", "
+              << cmd.second->start - origin << ", "
+              << cmd.second->end - origin << endl;
+    }
+  }
+  cerr << "phase, mean, p50, p99" << endl;
+  pair<const char*, vector<double>*> phases[] = {
+    {"upload", &upload}, {"kernel", &kernel}, {"download", &download},
+    {"host_gap", &host_gap}
+  };
+  for (auto& phase : phases) {
+    auto s = summarize(*phase.second);
+    cerr << phase.first << ", " << s.mean << ", " << s.p50 << ", " << s.p99
+         << endl;
+  }
+}
+
+// Bytes copied between host and device and their rate while the upload and
+// download commands ran on the device. Zero-copy runs copy nothing, their
+// mapping of the result is not counted as transfer.
+void print_transfer(const vector<iteration_profile>& profile,
+                    transfer_mode mode, size_t matrix_size) {
+  uint64_t up_ns = 0;
+  uint64_t down_ns = 0;
+  for (auto& p : profile) {
+    if (p.upload[0].queued != 0)
+      up_ns += max(p.upload[0].end, p.upload[1].end)
+               - min(p.upload[0].start, p.upload[1].start);
+    down_ns += p.download.end - p.download.start;
+  }
+  uint64_t up_bytes = 0;
+  uint64_t down_bytes = 0;
+  if (mode != transfer_mode::zero_copy) {
+    auto matrix_bytes = sizeof(float) * matrix_size * matrix_size;
+    up_bytes = 2 * matrix_bytes * profile.size();
+    down_bytes = matrix_bytes * profile.size();
+  }
+  auto rate = [](uint64_t bytes, uint64_t ns) {
+    return bytes > 0 && ns > 0 ? bytes * 1e9 / ns : 0.0;
+  };
+  cerr << "transfer, " << to_string(mode) << ", " << up_bytes + down_bytes
+       << ", " << rate(up_bytes, up_ns) << ", " << rate(down_bytes, down_ns)
+       << endl;
+}
+
+} // namespace <anonymous>
+
 void usage(const char* prog) {
   cout << "usage: ./" << prog << endl
        << "  -s <size>        (matrix size, required)" << endl
        << "  -i <iterations>  (iterations to measure, required)" << endl
        << "  -d <device-name> (choose the device to use)" << endl
-       << "The program only accepts arguments in that exact order." << endl;
+       << "  -k <kernel>      (matrix_mult, matrix_mult_tiled, "
+          "matrix_mult_reg2," << endl
+       << "                    matrix_mult_reg4 or matrix_mult_vec4)" << endl
+       << "  -c <directory>   (program binary cache, default: "
+       << default_program_cache << ", '-' disables it)" << endl
+       << "  -p <on|off>      (recycle device buffers across iterations, "
+          "default: off)" << endl
+       << "  -q <depth>       (iterations in flight, one queue each, "
+          "default: 1)" << endl
+       << "  -P <file>        (profile every iteration, writes the "
+          "timestamps to file" << endl
+       << "                    unless it is '-', prints a summary in us "
+          "to stderr)" << endl
+       << "  -t <mode>        (pageable, pinned or zero-copy transfers, "
+          "default: pageable)" << endl;
 }
 
 int main(int argc, char** argv) {
   string device_wish;
-  if (argc < 5 || string(argv[1]) != "-s" || string(argv[3]) != "-i") {
+  string size_arg;
+  string iterations_arg;
+  string kernel_wish = kernel_name;
+  string program_cache = default_program_cache;
+  bool pooled = false;
+  string depth_arg = "1";
+  bool profiling = false;
+  string profile_file;
+  auto mode = transfer_mode::pageable;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (i + 1 == argc) {
+      usage(argv[0]);
+      return 0;
+    }
+    string value = argv[++i];
+    if (arg == "-s") {
+      size_arg = value;
+    } else if (arg == "-i") {
+      iterations_arg = value;
+    } else if (arg == "-d") {
+      device_wish = value;
+    } else if (arg == "-k") {
+      kernel_wish = value;
+    } else if (arg == "-c") {
+      program_cache = value == "-" ? "" : value;
+    } else if (arg == "-p" && (value == "on" || value == "off")) {
+      pooled = value == "on";
+    } else if (arg == "-q") {
+      depth_arg = value;
+    } else if (arg == "-P") {
+      profiling = true;
+      profile_file = value == "-" ? "" : value;
+    } else if (arg == "-t" && parse_transfer_mode(value, mode)) {
+      // nop
+    } else {
+      usage(argv[0]);
+      return 0;
+    }
+  }
+  if (size_arg.empty() || iterations_arg.empty()) {
     usage(argv[0]);
     return 0;
-  } else if (argc == 6 || argc > 7) {
-    usage(argv[0]);
+  }
+  auto variant = find_matrix_kernel(kernel_wish);
+  if (!variant) {
+    cout << "Unknown kernel '" << kernel_wish << "'." << endl;
     return 0;
-  } else if (argc == 7) {
-    device_wish = string(argv[6]);
   }
   
   cl_int err = 0;
@@ -88,51 +239,57 @@ int main(int argc, char** argv) {
     return 0;
   }
   
-  auto matrix_size = static_cast<size_t>(stoi(argv[2]));
-  auto iterations  = static_cast<size_t>(stoi(argv[4]));
+  auto matrix_size = static_cast<size_t>(stoi(size_arg));
+  auto iterations  = static_cast<size_t>(stoi(iterations_arg));
+  auto depth       = static_cast<size_t>(max(stoi(depth_arg), 1));
+  vector<size_t> global_dims;
+  vector<size_t> local_dims;
+  if (!matrix_kernel_dims(*variant, matrix_size, global_dims, local_dims)) {
+    cout << "Kernel '" << variant->name << "' requires a matrix size that "
+         << "is a multiple of its blocking." << endl;
+    return 0;
+  }
   // create context
   context_ptr context;
   context.adopt(clCreateContext(0, 1, &device, nullptr, nullptr, &err));
   check_cl_error(err, "clCreateContext");
-  // create command queue
-  command_queue_ptr queue;
-  queue.adopt(clCreateCommandQueue(context.get(), device,
-                                   CL_QUEUE_PROFILING_ENABLE, &err));
-  check_cl_error(err, "clCreateCommandQueue");
-  // create program
-  const char* src     = kernel_source;
-  size_t      src_len = strlen(src);
-  program_ptr prog;
-  prog.adopt(clCreateProgramWithSource(context.get(), 1,
-                                       static_cast<const char**>(&src),
-                                       &src_len, &err));
-  check_cl_error(err, "clCreateProgramWithSource");
-  // build program from program object
-  err = clBuildProgram(prog.get(), 0, nullptr, nullptr, nullptr, nullptr);
-  if (err != CL_SUCCESS) {
-    auto err_string = get_opencl_error(err);
-    cl_build_status bs;
-    err = clGetProgramBuildInfo(prog.get(), device, CL_PROGRAM_BUILD_STATUS,
-                                sizeof(cl_build_status), &bs, nullptr);
-    size_t ret_val_size;
-    err = clGetProgramBuildInfo(prog.get(), device, CL_PROGRAM_BUILD_LOG,
-                                0, nullptr, &ret_val_size);
-    vector<char> build_log(ret_val_size+1);
-    err = clGetProgramBuildInfo(prog.get(), device, CL_PROGRAM_BUILD_LOG,
-                                ret_val_size, build_log.data(), nullptr);
-    build_log[ret_val_size] = '\0';
-    throw std::runtime_error("'clBuildProgram failed': " + err_string +
-                             "\nBuild log: " + string(build_log.data()));
+  // create command queues, in-order queues only overlap across each other
+  vector<command_queue_ptr> queues(depth);
+  for (auto& queue : queues) {
+    queue.adopt(clCreateCommandQueue(context.get(), device,
+                                     CL_QUEUE_PROFILING_ENABLE, &err));
+    check_cl_error(err, "clCreateCommandQueue");
   }
+  // create program
+  program_build_info build_info;
+  auto prog = build_program(context.get(), device, kernel_source, nullptr,
+                            program_cache, &build_info);
+  print_build_info("program", build_info);
   // init kernel
   kernel_ptr kernel;
-  kernel.adopt(clCreateKernel(prog.get(), kernel_name, &err));
+  kernel.adopt(clCreateKernel(prog.get(), variant->name, &err));
   check_cl_error(err, "clCreateKernel");
-  cmd c(matrix_size, kernel, context, queue, iterations);
+  buffer_pool pool{context, pooled};
+  cmd c(matrix_size, kernel, context, move(queues), iterations,
+        global_dims, local_dims, pool, mode);
+  if (profiling)
+    c.enable_profiling();
   auto start_ = chrono::high_resolution_clock::now();
   c.enqueue();
   c.wait();
   auto end_ = chrono::high_resolution_clock::now();
-  cout << chrono::duration_cast<chrono::microseconds>((end_ - start_)).count()
+  auto runtime = chrono::duration_cast<chrono::microseconds>(end_ - start_);
+  cout << runtime.count() << endl;
+  cerr << "pipeline, " << depth << ", " << runtime.count() << ", "
+       << (runtime.count() > 0 ? iterations * 1e6 / runtime.count() : 0.0)
        << endl;
+  auto stats = pool.stats();
+  cerr << "pool, " << (pooled ? "on" : "off") << ", " << stats.hits << ", "
+       << stats.misses << ", " << stats.bytes_outstanding << ", "
+       << stats.peak_bytes_outstanding << ", " << stats.bytes_pooled << endl;
+  if (profiling) {
+    auto profile = c.profile();
+    print_transfer(profile, mode, matrix_size);
+    print_profile(profile, profile_file);
+  }
 }
@@ -1,5 +1,6 @@
 #include <chrono>
 #include <vector>
+#include <fstream>
 #include <iomanip>
 #include <numeric>
 #include <iostream>
@@ -10,69 +11,52 @@
 #include "include/util.hpp"
 #include "include/config.hpp"
 #include "include/kernel.hpp"
+#include "include/statistics.hpp"
+#include "include/program_cache.hpp"
+#include "include/request_tracer.hpp"
 
 using namespace std;
 using namespace std::chrono;
 using namespace caf;
 using namespace caf::opencl;
 
-#define ADDED_TIMEPOINTS_TO_CAF
-#undef ADDED_TIMEPOINTS_TO_CAF
-
-/**
- * Note that this benchmark requires modification of CAF.
- * The external variables must be added to the command class,
- *    actor-framework/libcaf_opencl/caf/opencl/command.hpp
- * in lines 44 and 45 add
- *    static std::chrono::high_resolution_clock::time_point a;
- *    static std::chrono::high_resolution_clock::time_point b;
- * in line 100 at the beginning of the first enqueue function
- *    a = std::chrono::high_resolution_clock::now();
- * in line 229 in the first line of the function handle_results
- *    b = std::chrono::high_resolution_clock::now();
- */
-#ifdef ADDED_TIMEPOINTS_TO_CAF
-extern high_resolution_clock::time_point a;
-extern high_resolution_clock::time_point b;
-#else
-high_resolution_clock::time_point a;
-high_resolution_clock::time_point b;
-#endif
-
 namespace {
 
 using calc_atom = atom_constant<atom("calc")>;
 
 class multiplier : public event_based_actor {
 public:
-  multiplier(actor_config& cfg, size_t matrix_size, actor worker)
+  multiplier(actor_config& cfg, size_t matrix_size, size_t requests,
+             actor worker, request_tracer& tracer)
     : event_based_actor(cfg),
       count_(0),
       size_(matrix_size),
-      worker_(worker) {
+      requests_(requests),
+      worker_(worker),
+      tracer_(tracer) {
     // nop
   }
 
   behavior make_behavior() override {
     return {
       [=] (calc_atom) {
-        ++count_;
+        // nothing to measure with neither warmup nor iterations
+        if (count_ >= requests_) {
+          quit();
+          return;
+        }
         vector<float> m1(size_ * size_);
         vector<float> m2(size_ * size_);
         iota(m1.begin(), m1.end(), 0);
         iota(m2.begin(), m2.end(), 0);
-        start_ = high_resolution_clock::now();
-        send(worker_, move(m1), move(m2));
+        send(worker_, tracer_.sent(), move(m1), move(m2));
       },
-      [=] (const vector<float>&) {
-        end_ = high_resolution_clock::now();
-        auto total = (end_ - start_);
-        auto time_in_opencl = (b - a);
-        cout << duration_cast<microseconds>(total).count()
-             << ", " << duration_cast<microseconds>(time_in_opencl).count()
-             << ", " << duration_cast<microseconds>(total - time_in_opencl).count()
-             << endl;
-        quit();
+      [=] (uint64_t id, const vector<float>&) {
+        tracer_.delivered(id);
+        if (++count_ >= requests_)
+          quit();
+        else
+          send(this, calc_atom::value);
       }
     };
   }
@@ -80,9 +64,9 @@ public:
 private:
   size_t count_;
   size_t size_;
+  size_t requests_;
   actor worker_;
-  chrono::high_resolution_clock::time_point start_;
-  chrono::high_resolution_clock::time_point end_;
+  request_tracer& tracer_;
 };
 
 class config : public actor_system_config {
@@ -90,26 +74,32 @@ public:
   string device_name = "GeForce GT 650M";
   size_t size = 0;
   size_t iterations = 1;
+  size_t warmup = 1;
+  string trace_file;
+  string program_cache = default_program_cache;
   config() {
     load<opencl::manager>();
     opt_group{custom_options_, "global"}
     .add(device_name, "device,d", "device for computation (GeForce GT 650M, "
                       ", but will take first available device if not found)")
     .add(size, "size,s", "set matrix size (must be > 0)")
-    .add(iterations, "iterations,i", "set iterations (deault: 1)");
+    .add(iterations, "iterations,i", "set iterations (deault: 1)")
+    .add(warmup, "warmup,w", "requests excluded from the results (1)")
+    .add(trace_file, "trace", "write the timestamps of every request to "
+                              "this file")
+    .add(program_cache, "program-cache", "directory for compiled program "
+                                         "binaries, empty disables it "
+                                         "(program-cache)");
   }
 };
 
+double us(request_trace::time_point from, request_trace::time_point to) {
+  return duration_cast<nanoseconds>(to - from).count() / 1000.0;
+}
+
 } // namespace anonymous
 
 void caf_main(actor_system& system, const config& cfg) {
-#ifndef ADDED_TIMEPOINTS_TO_CAF
-  cout << "This benchmark requires you to adjust the command class "
-          "in CAF and remove the `#undef ADDED_TIMEPOINTS_TO_CAF` at "
-          "the top of this file" << std::endl;
-  static_cast<void>(system);
-  static_cast<void>(cfg);
-#else
   auto& mngr = system.opencl_manager();
   // get device named in config ...
   auto opt = mngr.find_device_if([&](const opencl::device_ptr dev) {
@@ -125,14 +115,66 @@ void caf_main(actor_system& system, const config& cfg) {
     return;
   }
   auto dev = *opt;
-  auto prog = mngr.create_program(kernel_source, "", dev);
+  program_build_info build_info;
+  auto prog = create_cached_program(dev, kernel_source, "", cfg.program_cache,
+                                    &build_info);
+  print_build_info("program", build_info);
+  auto requests = cfg.warmup + cfg.iterations;
+  request_tracer tracer{requests};
+  // the mappings run right before the actor enqueues its commands and
+  // right after it read back the result, i.e., they bracket the OpenCL work
+  auto unbox_args = [&](message& msg) -> optional<message> {
+    tracer.submitted(msg.get_as<uint64_t>(0));
+    return msg.drop(1);
+  };
+  auto box_res = [&](vector<float> result) -> message {
+    return make_message(tracer.completed(), move(result));
+  };
   auto worker = mngr.spawn(prog, kernel_name,
                            nd_range{dim_vec{cfg.size, cfg.size}},
+                           unbox_args, box_res,
                            in<float>{}, in<float>{}, out<float>{});
-  auto mult = system.spawn<multiplier>(cfg.size, worker);
+  auto mult = system.spawn<multiplier>(cfg.size, requests, worker, tracer);
   anon_send(mult, calc_atom::value);
   system.await_all_actors_done();
-#endif
+  vector<double> total;
+  vector<double> opencl;
+  vector<double> overhead;
+  vector<double> dispatch;
+  vector<double> delivery;
+  auto& traces = tracer.traces();
+  for (size_t i = cfg.warmup; i < traces.size(); ++i) {
+    auto& t = traces[i];
+    total.push_back(us(t.sent, t.delivered));
+    opencl.push_back(us(t.submitted, t.completed));
+    overhead.push_back(total.back() - opencl.back());
+    dispatch.push_back(us(t.sent, t.submitted));
+    delivery.push_back(us(t.completed, t.delivered));
+  }
+  if (!cfg.trace_file.empty()) {
+    ofstream out{cfg.trace_file};
+    out << "request, sent, submitted, completed, delivered" << endl;
+    // without any measured request the trace only has its header
+    if (!traces.empty()) {
+      auto origin = traces.front().sent;
+      for (size_t i = 0; i < traces.size(); ++i) {
+        auto& t = traces[i];
+        out << i << ", " << us(origin, t.sent) << ", "
+            << us(origin, t.submitted) << ", " << us(origin, t.completed)
+            << ", " << us(origin, t.delivered) << endl;
+      }
+    }
+  }
+  cout << "measure, mean, p50, p99, max" << endl;
+  pair<const char*, vector<double>*> measures[] = {
+    {"total", &total}, {"opencl", &opencl}, {"overhead", &overhead},
+    {"dispatch", &dispatch}, {"delivery", &delivery}
+  };
+  for (auto& m : measures) {
+    auto s = summarize(*m.second);
+    cout << m.first << ", " << s.mean << ", " << s.p50 << ", " << s.p99
+         << ", " << s.max << endl;
+  }
 }
 
 CAF_MAIN();
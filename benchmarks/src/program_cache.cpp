@@ -0,0 +1,173 @@
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <iostream>
+
+#include <sys/stat.h>
+
+#include "include/autotuner.hpp"
+#include "include/program_cache.hpp"
+
+using namespace std;
+
+namespace {
+
+// FNV-1a, only used to derive file names.
+uint64_t hash_combine(uint64_t hash, const string& str) {
+  for (auto c : str) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+string cache_file(const string& dir, cl_device_id device, const char* source,
+                  const char* options) {
+  uint64_t hash = 14695981039346656037ull;
+  hash = hash_combine(hash, source);
+  hash = hash_combine(hash, options ? options : "");
+  hash = hash_combine(hash, device_identity(device));
+  ostringstream oss;
+  oss << dir << "/" << hex << setw(16) << setfill('0') << hash << ".bin";
+  return oss.str();
+}
+
+void check_build(cl_int err, cl_program prog, cl_device_id device) {
+  if (err == CL_SUCCESS)
+    return;
+  size_t size = 0;
+  clGetProgramBuildInfo(prog, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &size);
+  vector<char> build_log(size + 1, '\0');
+  clGetProgramBuildInfo(prog, device, CL_PROGRAM_BUILD_LOG, size,
+                        build_log.data(), nullptr);
+  throw runtime_error("'clBuildProgram failed': " + get_opencl_error(err)
+                      + "\nBuild log: " + string(build_log.data()));
+}
+
+program_ptr load_binary(cl_context context, cl_device_id device,
+                        const char* options, const string& file) {
+  ifstream in{file, ios::binary};
+  if (!in)
+    return program_ptr{};
+  vector<unsigned char> binary{istreambuf_iterator<char>{in},
+                               istreambuf_iterator<char>{}};
+  if (binary.empty())
+    return program_ptr{};
+  auto size = binary.size();
+  auto data = static_cast<const unsigned char*>(binary.data());
+  cl_int status = CL_SUCCESS;
+  cl_int err = CL_SUCCESS;
+  program_ptr prog;
+  prog.adopt(clCreateProgramWithBinary(context, 1, &device, &size, &data,
+                                       &status, &err));
+  if (err != CL_SUCCESS || status != CL_SUCCESS)
+    return program_ptr{};
+  // binaries still need to be built, drivers may reject them here as well
+  err = clBuildProgram(prog.get(), 1, &device, options, nullptr, nullptr);
+  if (err != CL_SUCCESS)
+    return program_ptr{};
+  return prog;
+}
+
+void store_binary(cl_program prog, const string& dir, const string& file) {
+  size_t size = 0;
+  auto err = clGetProgramInfo(prog, CL_PROGRAM_BINARY_SIZES, sizeof(size_t),
+                              &size, nullptr);
+  if (err != CL_SUCCESS || size == 0)
+    return;
+  vector<unsigned char> binary(size);
+  auto data = binary.data();
+  err = clGetProgramInfo(prog, CL_PROGRAM_BINARIES, sizeof(unsigned char*),
+                         &data, nullptr);
+  if (err != CL_SUCCESS)
+    return;
+  mkdir(dir.c_str(), 0755);
+  // write to a temporary file first, concurrent runs may share the cache
+  auto tmp = file + ".tmp";
+  {
+    ofstream out{tmp, ios::binary};
+    out.write(reinterpret_cast<const char*>(binary.data()), size);
+    if (!out)
+      return;
+  }
+  rename(tmp.c_str(), file.c_str());
+}
+
+} // namespace <anonymous>
+
+program_ptr build_program(cl_context context, cl_device_id device,
+                          const char* source, const char* options,
+                          const string& cache_dir, program_build_info* info) {
+  auto start = chrono::high_resolution_clock::now();
+  auto done = [&](bool hit) {
+    if (!info)
+      return;
+    info->cache_hit = hit;
+    info->build_us = chrono::duration_cast<chrono::microseconds>(
+      chrono::high_resolution_clock::now() - start
+    ).count();
+  };
+  string file;
+  if (!cache_dir.empty()) {
+    file = cache_file(cache_dir, device, source, options);
+    auto prog = load_binary(context, device, options, file);
+    if (prog) {
+      done(true);
+      return prog;
+    }
+    remove(file.c_str());
+  }
+  cl_int err = CL_SUCCESS;
+  size_t src_len = strlen(source);
+  program_ptr prog;
+  prog.adopt(clCreateProgramWithSource(context, 1, &source, &src_len, &err));
+  check_cl_error(err, "clCreateProgramWithSource");
+  err = clBuildProgram(prog.get(), 1, &device, options, nullptr, nullptr);
+  check_build(err, prog.get(), device);
+  if (!file.empty())
+    store_binary(prog.get(), cache_dir, file);
+  done(false);
+  return prog;
+}
+
+caf::opencl::program_ptr
+create_cached_program(const caf::opencl::device_ptr& dev, const char* source,
+                      const char* options, const string& cache_dir,
+                      program_build_info* info) {
+  using namespace caf;
+  auto prog = build_program(dev->get_context(), dev->get_device(), source,
+                            options, cache_dir, info);
+  // mirrors manager::create_program, which registers all kernels up front
+  cl_uint num_kernels = 0;
+  auto err = clCreateKernelsInProgram(prog.get(), 0, nullptr, &num_kernels);
+  check_cl_error(err, "clCreateKernelsInProgram");
+  vector<cl_kernel> kernels(num_kernels);
+  err = clCreateKernelsInProgram(prog.get(), num_kernels, kernels.data(),
+                                 nullptr);
+  check_cl_error(err, "clCreateKernelsInProgram");
+  map<string, detail::raw_kernel_ptr> available_kernels;
+  for (auto kernel : kernels) {
+    size_t size = 0;
+    clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, 0, nullptr, &size);
+    vector<char> name(size + 1, '\0');
+    clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, size, name.data(),
+                    nullptr);
+    available_kernels.emplace(string(name.data()),
+                              detail::raw_kernel_ptr{kernel, false});
+  }
+  return make_counted<opencl::program>(
+    detail::raw_context_ptr{dev->get_context()},
+    detail::raw_command_queue_ptr{dev->get_queue()},
+    detail::raw_program_ptr{prog.get()},
+    move(available_kernels)
+  );
+}
+
+void print_build_info(const string& label, const program_build_info& info) {
+  cerr << label << ", " << (info.cache_hit ? "hit" : "miss") << ", "
+       << info.build_us << endl;
+}
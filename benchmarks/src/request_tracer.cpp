@@ -0,0 +1,45 @@
+#include "include/request_tracer.hpp"
+
+using namespace std;
+
+namespace {
+
+request_trace::time_point now() {
+  return chrono::high_resolution_clock::now();
+}
+
+} // namespace <anonymous>
+
+request_tracer::request_tracer(size_t capacity) {
+  traces_.reserve(capacity);
+}
+
+uint64_t request_tracer::sent() {
+  lock_guard<mutex> guard{mtx_};
+  request_trace trace;
+  trace.sent = now();
+  traces_.push_back(trace);
+  return traces_.size() - 1;
+}
+
+void request_tracer::submitted(uint64_t id) {
+  auto t = now();
+  lock_guard<mutex> guard{mtx_};
+  traces_[id].submitted = t;
+  pending_.push_back(id);
+}
+
+uint64_t request_tracer::completed() {
+  auto t = now();
+  lock_guard<mutex> guard{mtx_};
+  auto id = pending_.front();
+  pending_.pop_front();
+  traces_[id].completed = t;
+  return id;
+}
+
+void request_tracer::delivered(uint64_t id) {
+  auto t = now();
+  lock_guard<mutex> guard{mtx_};
+  traces_[id].delivered = t;
+}
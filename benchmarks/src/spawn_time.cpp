@@ -10,6 +10,11 @@
 #include "include/util.hpp"
 #include "include/config.hpp"
 #include "include/kernel.hpp"
+#include "include/autotuner.hpp"
+#include "include/kernel_pool.hpp"
+#include "include/concurrent_spawn.hpp"
+#include "include/memory_usage.hpp"
+#include "include/program_cache.hpp"
 
 using namespace std;
 using namespace caf;
@@ -22,6 +27,13 @@ public:
   string device_name = "GeForce GT 650M";
   size_t size = 0;
   size_t iterations = 1;
+  bool tune = false;
+  string tuning_cache = "tuning.cache";
+  string program_cache = default_program_cache;
+  bool pooled = false;
+  size_t pool_size = 1;
+  size_t spawners = 0;
+  bool memory = false;
   //  announce<vector<float>>("vector_float");
   config() {
     load<opencl::manager>();
@@ -29,7 +41,21 @@ public:
     .add(device_name, "device,d", "device for computation (GeForce GT 650M, "
                       ", but will take first available device if not found)")
     .add(size, "size,s", "set matrix size (must be > 0)")
-    .add(iterations, "iterations,i", "set iterations (deault: 1)");
+    .add(iterations, "iterations,i", "set iterations (deault: 1)")
+    .add(tune, "tune", "run the autotuner if the tuning cache has no entry")
+    .add(tuning_cache, "tuning-cache", "file with tuned launch configurations "
+                                       "(tuning.cache)")
+    .add(program_cache, "program-cache", "directory for compiled program "
+                                         "binaries, empty disables it "
+                                         "(program-cache)")
+    .add(pooled, "pooled", "spawn facades that share a pool of OpenCL "
+                           "actors instead of one OpenCL actor each")
+    .add(pool_size, "pool-size", "OpenCL actors shared by all facades (1)")
+    .add(spawners, "spawners,t", "spawn from this many concurrent actors "
+                                 "and print throughput, latency and peak "
+                                 "RSS, 0 spawns from main (0)")
+    .add(memory, "memory", "keep all actors alive and print the resident "
+                           "memory per actor");
   }
 };
 
@@ -49,12 +75,76 @@ void caf_main(actor_system& system, const config& cfg) {
     return;
   }
   auto dev = *opt;
+  launch_config launch;
+  launch.kernel = kernel_name6;
+  launch.global = {cfg.size};
+  {
+    tuning_cache cache{cfg.tuning_cache};
+    auto problem = string{kernel_name6} + "/" + to_string(cfg.size);
+    // only the tuner needs input data
+    if (!cache.find(raw_device_id(dev), problem, launch) && cfg.tune) {
+      vector<float> input(cfg.size);
+      tuning_arg arg{sizeof(float) * input.size(), input.data()};
+      tuned_config(cache, true, raw_device_id(dev), problem, kernel_source,
+                   {tuning_candidate{kernel_name6, launch.global, {}}},
+                   {arg, arg}, launch);
+    }
+  }
   auto start_ = chrono::high_resolution_clock::now();
-  auto prog = mngr.create_program(kernel_source, "", dev);
-  auto ndr = nd_range{dim_vec{cfg.size}};
-  for(size_t i = 1; i < cfg.iterations; ++i)
-    mngr.spawn(prog, kernel_name6, ndr, in<float>{}, out<float>{});
-  auto last = mngr.spawn(prog, kernel_name6, ndr, in<float>{}, out<float>{});
+  program_build_info build_info;
+  auto prog = create_cached_program(dev, kernel_source, "", cfg.program_cache,
+                                    &build_info);
+  auto ndr = to_nd_range(launch);
+  kernel_pool_ptr pool;
+  if (cfg.pooled)
+    pool = make_shared<kernel_pool>([=, &mngr] {
+      return mngr.spawn(prog, kernel_name6, ndr, in<float>{}, out<float>{});
+    }, cfg.pool_size);
+  using facade = pooled_facade<vector<float>>;
+  if (cfg.spawners > 0) {
+    function<actor ()> spawn_one;
+    if (pool)
+      spawn_one = [&] { return system.spawn<facade, lazy_init>(pool); };
+    else
+      spawn_one = [&] {
+        return mngr.spawn(prog, kernel_name6, ndr, in<float>{}, out<float>{});
+      };
+    auto report = concurrent_spawn(system, cfg.spawners, cfg.iterations,
+                                   spawn_one);
+    print_spawn_report(report, cfg.scheduler_max_threads);
+    print_build_info("program", build_info);
+    system.await_all_actors_done();
+    return;
+  }
+  // only keep the actors alive when measuring their memory, otherwise the
+  // loops match the original benchmark
+  vector<actor> actors;
+  // sampled after building the program, which is not part of an actor, and
+  // only when measuring memory to keep reading it out of the timed region
+  size_t rss_before = 0;
+  if (cfg.memory) {
+    actors.reserve(cfg.iterations);
+    rss_before = resident_bytes();
+  }
+  actor last;
+  if (pool) {
+    if (cfg.memory)
+      for(size_t i = 1; i < cfg.iterations; ++i)
+        actors.push_back(system.spawn<facade, lazy_init>(pool));
+    else
+      for(size_t i = 1; i < cfg.iterations; ++i)
+        system.spawn<facade, lazy_init>(pool);
+    last = system.spawn<facade>(pool);
+  } else {
+    if (cfg.memory)
+      for(size_t i = 1; i < cfg.iterations; ++i)
+        actors.push_back(mngr.spawn(prog, kernel_name6, ndr,
+                                    in<float>{}, out<float>{}));
+    else
+      for(size_t i = 1; i < cfg.iterations; ++i)
+        mngr.spawn(prog, kernel_name6, ndr, in<float>{}, out<float>{});
+    last = mngr.spawn(prog, kernel_name6, ndr, in<float>{}, out<float>{});
+  }
   vector<float> m1(cfg.size);
   iota(m1.begin(), m1.end(), 0);
   {
@@ -75,6 +165,16 @@ void caf_main(actor_system& system, const config& cfg) {
   auto end_ = chrono::high_resolution_clock::now();
   cout << chrono::duration_cast<chrono::microseconds>((end_ - start_)).count()
        << endl;
+  print_build_info("program", build_info);
+  if (cfg.memory) {
+    auto rss_after = resident_bytes();
+    cerr << "memory, " << (cfg.pooled ? "pooled" : "plain") << ", "
+         << (rss_after > rss_before ? rss_after - rss_before : 0)
+            / max(cfg.iterations, size_t{1})
+         << ", " << (pool ? pool->spawned() : cfg.iterations) << endl;
+  }
+  actors.clear();
+  last = nullptr;
   system.await_all_actors_done();
 }
 
@@ -7,6 +7,8 @@
 #include "caf/all.hpp"
 
 #include "include/config.hpp"
+#include "include/memory_usage.hpp"
+#include "include/concurrent_spawn.hpp"
 
 using namespace std;
 using namespace caf;
@@ -32,18 +34,44 @@ public:
   string device_name = "GeForce GT 650M";
   size_t size = 0;
   size_t iterations = 1;
+  size_t spawners = 0;
+  bool memory = false;
   config() {
     opt_group{custom_options_, "global"}
     .add(device_name, "device,d", "Will be ignored. Just here for a unified interface.")
     .add(size, "size,s", "set matrix size (must be > 0)")
-    .add(iterations, "iterations,i", "set iterations (deault: 1)");
+    .add(iterations, "iterations,i", "set iterations (deault: 1)")
+    .add(spawners, "spawners,t", "spawn from this many concurrent actors "
+                                 "and print throughput, latency and peak "
+                                 "RSS, 0 spawns from main (0)")
+    .add(memory, "memory", "keep all actors alive and print the resident "
+                           "memory per actor");
   }
 };
 
 void caf_main(actor_system& system, const config& cfg) {
+  if (cfg.spawners > 0) {
+    auto report = concurrent_spawn(system, cfg.spawners, cfg.iterations, [&] {
+      return system.spawn<dummy, lazy_init>();
+    });
+    print_spawn_report(report, cfg.scheduler_max_threads);
+    system.await_all_actors_done();
+    return;
+  }
+  // only keep the actors alive when measuring their memory, otherwise the
+  // loop matches the original benchmark
+  vector<actor> actors;
+  if (cfg.memory)
+    actors.reserve(cfg.iterations);
+  auto rss_before = resident_bytes();
   auto start_ = chrono::high_resolution_clock::now();
-  for(size_t i = 1; i < cfg.iterations; ++i)
-      system.spawn<dummy, lazy_init>();
+  if (cfg.memory) {
+    for(size_t i = 1; i < cfg.iterations; ++i)
+      actors.push_back(system.spawn<dummy, lazy_init>());
+  } else {
+    for(size_t i = 1; i < cfg.iterations; ++i)
+        system.spawn<dummy, lazy_init>();
+  }
   auto last = system.spawn<dummy>();
   {
     scoped_actor self{system};
@@ -55,6 +83,15 @@ void caf_main(actor_system& system, const config& cfg) {
   auto end_ = chrono::high_resolution_clock::now();
   cout << chrono::duration_cast<chrono::microseconds>((end_ - start_)).count()
        << endl;
+  if (cfg.memory) {
+    auto rss_after = resident_bytes();
+    cerr << "memory, core, "
+         << (rss_after > rss_before ? rss_after - rss_before : 0)
+            / max(cfg.iterations, size_t{1})
+         << endl;
+  }
+  actors.clear();
+  last = nullptr;
   system.await_all_actors_done();
 }
 
@@ -0,0 +1,134 @@
+#include <algorithm>
+
+#include "include/thread_pool.hpp"
+
+using namespace std;
+
+task_queue::task_queue(size_t capacity)
+    : enqueue_pos_(0),
+      dequeue_pos_(0) {
+  size_t size = 2;
+  while (size < capacity)
+    size <<= 1;
+  slots_ = vector<slot>(size);
+  for (size_t i = 0; i < size; ++i)
+    slots_[i].sequence.store(i, memory_order_relaxed);
+  mask_ = size - 1;
+}
+
+bool task_queue::try_push(task& x) {
+  auto pos = enqueue_pos_.load(memory_order_relaxed);
+  for (;;) {
+    auto& s = slots_[pos & mask_];
+    auto seq = s.sequence.load(memory_order_acquire);
+    auto diff = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos);
+    if (diff == 0) {
+      if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                             memory_order_relaxed)) {
+        s.value = move(x);
+        s.sequence.store(pos + 1, memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = enqueue_pos_.load(memory_order_relaxed);
+    }
+  }
+}
+
+bool task_queue::try_pop(task& x) {
+  auto pos = dequeue_pos_.load(memory_order_relaxed);
+  for (;;) {
+    auto& s = slots_[pos & mask_];
+    auto seq = s.sequence.load(memory_order_acquire);
+    auto diff = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos + 1);
+    if (diff == 0) {
+      if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                             memory_order_relaxed)) {
+        x = move(s.value);
+        s.value = nullptr;
+        s.sequence.store(pos + mask_ + 1, memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = dequeue_pos_.load(memory_order_relaxed);
+    }
+  }
+}
+
+thread_pool::thread_pool(size_t threads, size_t queue_capacity)
+    : queue_(queue_capacity),
+      pending_(0),
+      sleeping_(0),
+      stop_(false) {
+  threads_.reserve(threads);
+  for (size_t i = 0; i < threads; ++i)
+    threads_.emplace_back([=] { run(); });
+}
+
+thread_pool::~thread_pool() {
+  {
+    lock_guard<mutex> guard{mtx_};
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto& t : threads_)
+    t.join();
+}
+
+void thread_pool::submit(task f) {
+  // Either a parking thread sees the new task or we see the sleeper, taking
+  // the lock makes sure it actually waits before we notify.
+  ++pending_;
+  while (!queue_.try_push(f))
+    if (!run_pending_task())
+      this_thread::yield();
+  if (sleeping_ > 0) {
+    { lock_guard<mutex> guard{mtx_}; }
+    cv_.notify_one();
+  }
+}
+
+void thread_pool::parallel_for(size_t first, size_t last, size_t chunk,
+                               const function<void(size_t, size_t)>& f) {
+  if (first >= last)
+    return;
+  chunk = max(chunk, size_t{1});
+  auto chunks = (last - first + chunk - 1) / chunk;
+  atomic<size_t> remaining{chunks};
+  for (size_t begin = first; begin < last; begin += chunk) {
+    auto end = min(begin + chunk, last);
+    submit([&, begin, end] {
+      f(begin, end);
+      --remaining;
+    });
+  }
+  while (remaining > 0)
+    if (!run_pending_task())
+      this_thread::yield();
+}
+
+bool thread_pool::run_pending_task() {
+  task f;
+  if (!queue_.try_pop(f))
+    return false;
+  --pending_;
+  f();
+  return true;
+}
+
+void thread_pool::run() {
+  for (;;) {
+    if (run_pending_task())
+      continue;
+    unique_lock<mutex> guard{mtx_};
+    ++sleeping_;
+    cv_.wait(guard, [&] { return pending_ > 0 || stop_; });
+    --sleeping_;
+    if (stop_ && pending_ == 0)
+      return;
+  }
+}